@@ -0,0 +1,244 @@
+// dark-log-decode: 将 dark-server 的二进制日志渲染为文本
+//
+// 用法: dark-log-decode <binary-log-file>
+// 输出格式与 LoggingService 的文本模式一致
+
+#include "dark-server.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace DarkServer;
+
+namespace {
+
+struct FormatInfo {
+    LogLevel level;
+    std::string format;
+};
+
+const char* levelName(LogLevel level) {
+    switch (level) {
+    case LogLevel::Debug: return "DEBUG";
+    case LogLevel::Info: return "INFO";
+    case LogLevel::Warn: return "WARN";
+    case LogLevel::Error: return "ERROR";
+    }
+    return "INFO";
+}
+
+size_t alignRecord(size_t size) {
+    return (size + 7) & ~size_t{7};
+}
+
+std::string formatTimestamp(uint64_t systemNs) {
+    std::time_t seconds = static_cast<std::time_t>(systemNs / 1000000000ULL);
+    unsigned ms = static_cast<unsigned>((systemNs / 1000000ULL) % 1000);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", std::gmtime(&seconds));
+    char out[48];
+    std::snprintf(out, sizeof(out), "%s.%03uZ", buf, ms);
+    return out;
+}
+
+// 解码一个参数, 越界时返回 false
+bool decodeArg(const char*& p, const char* end, std::string& out) {
+    if (p >= end) return false;
+    auto type = static_cast<BinaryLogArgType>(*p++);
+    switch (type) {
+    case BinaryLogArgType::Int: {
+        int64_t v;
+        if (end - p < static_cast<ptrdiff_t>(sizeof(v))) return false;
+        std::memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        out = std::to_string(v);
+        return true;
+    }
+    case BinaryLogArgType::UInt: {
+        uint64_t v;
+        if (end - p < static_cast<ptrdiff_t>(sizeof(v))) return false;
+        std::memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        out = std::to_string(v);
+        return true;
+    }
+    case BinaryLogArgType::Double: {
+        double v;
+        if (end - p < static_cast<ptrdiff_t>(sizeof(v))) return false;
+        std::memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        out = std::to_string(v);
+        return true;
+    }
+    case BinaryLogArgType::String: {
+        uint32_t len;
+        if (end - p < static_cast<ptrdiff_t>(sizeof(len))) return false;
+        std::memcpy(&len, p, sizeof(len));
+        p += sizeof(len);
+        if (end - p < static_cast<ptrdiff_t>(len)) return false;
+        out.assign(p, len);
+        p += len;
+        return true;
+    }
+    }
+    return false;
+}
+
+// 读取 offset 处的记录头, 记录须完整落在 end 之前; 未写完的记录 size 为 0
+bool readRecord(const std::vector<char>& data, size_t offset, size_t end, BinaryLogRecordHeader& rec) {
+    if (offset + sizeof(rec) > end) return false;
+    std::memcpy(&rec, data.data() + offset, sizeof(rec));
+    return rec.size >= sizeof(rec) && rec.size <= end - offset &&
+           rec.kind <= static_cast<uint8_t>(BinaryLogRecordKind::Event);
+}
+
+struct RingRecord {
+    size_t offset;             // 文件偏移
+    BinaryLogRecordHeader header;
+};
+
+std::string render(const std::string& format, const std::vector<std::string>& args) {
+    std::string out;
+    size_t pos = 0;
+    for (const auto& arg : args) {
+        size_t slot = format.find("{}", pos);
+        if (slot == std::string::npos) break;
+        out.append(format, pos, slot - pos);
+        out += arg;
+        pos = slot + 2;
+    }
+    out.append(format, pos, std::string::npos);
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "用法: " << argv[0] << " <binary-log-file>" << std::endl;
+        return 2;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "无法打开文件: " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    BinaryLogFileHeader header;
+    if (data.size() < sizeof(header)) {
+        std::cerr << "文件过短, 不是二进制日志" << std::endl;
+        return 1;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, kBinaryLogMagic, sizeof(header.magic)) != 0 || header.version != 2 ||
+        header.formatAreaEnd < sizeof(header) || header.formatAreaEnd >= header.capacity) {
+        std::cerr << "无法识别的二进制日志格式" << std::endl;
+        return 1;
+    }
+
+    std::string serviceName(header.serviceName, strnlen(header.serviceName, sizeof(header.serviceName)));
+    // 环形区未写满一圈时文件在关闭时被截短, 未写到的部分视为空
+    size_t fileEnd = std::min<size_t>(header.capacity, data.size());
+    size_t formatEnd = std::min<size_t>(header.formatAreaEnd, fileEnd);
+    size_t ringBegin = header.formatAreaEnd;
+    uint64_t ringSize = header.capacity - header.formatAreaEnd;
+
+    std::map<uint16_t, FormatInfo> formats;
+    auto addFormat = [&](size_t offset, const BinaryLogRecordHeader& rec) {
+        if (rec.kind != static_cast<uint8_t>(BinaryLogRecordKind::Format) || rec.size <= sizeof(rec)) return;
+        const char* payload = data.data() + offset + sizeof(rec);
+        formats[rec.formatId] = FormatInfo{static_cast<LogLevel>(payload[0]),
+                                           std::string(payload + 1, rec.size - sizeof(rec) - 1)};
+    };
+
+    // 格式区: 只追加、不覆盖; 进程崩溃时可能留下未写完的记录, 跳过后继续
+    for (size_t offset = alignRecord(header.headerSize); offset + sizeof(BinaryLogRecordHeader) <= formatEnd;) {
+        BinaryLogRecordHeader rec;
+        if (readRecord(data, offset, formatEnd, rec) && rec.sequence == 0) {
+            addFormat(offset, rec);
+            offset += alignRecord(rec.size);
+        } else {
+            offset += 8;
+        }
+    }
+
+    // 环形区: 按记录头扫描, sequence 必须与物理偏移一致; 遇到未写完或被
+    // 覆盖了一半的记录时按8字节向后找下一条完整的记录
+    std::vector<RingRecord> records;
+    uint64_t newestEnd = 0;
+    for (size_t offset = ringBegin; offset + sizeof(BinaryLogRecordHeader) <= fileEnd;) {
+        BinaryLogRecordHeader rec;
+        if (readRecord(data, offset, fileEnd, rec) && rec.sequence % ringSize == offset - ringBegin) {
+            records.push_back(RingRecord{offset, rec});
+            newestEnd = std::max<uint64_t>(newestEnd, rec.sequence + alignRecord(rec.size));
+            offset += alignRecord(rec.size);
+        } else {
+            offset += 8;
+        }
+    }
+
+    // 只有最近一圈 [newestEnd - ringSize, newestEnd) 内的记录有效, 更早的已被覆盖
+    uint64_t oldest = newestEnd > ringSize ? newestEnd - ringSize : 0;
+    records.erase(std::remove_if(records.begin(), records.end(),
+                                 [&](const RingRecord& r) { return r.header.sequence < oldest; }),
+                  records.end());
+    std::sort(records.begin(), records.end(), [](const RingRecord& a, const RingRecord& b) {
+        return a.header.sequence < b.header.sequence;
+    });
+    // 格式区写满后格式记录也会进入环形区
+    for (const auto& r : records) {
+        addFormat(r.offset, r.header);
+    }
+
+    // 按 sequence 从旧到新渲染事件
+    uint64_t rendered = 0;
+    std::vector<std::string> args;
+    uint64_t previousEnd = 0;
+    for (const auto& r : records) {
+        const BinaryLogRecordHeader& rec = r.header;
+        // 与前一条重叠的只可能是残留在负载中的旧数据
+        if (rec.sequence < previousEnd) continue;
+        previousEnd = rec.sequence + alignRecord(rec.size);
+        if (rec.kind != static_cast<uint8_t>(BinaryLogRecordKind::Event)) continue;
+        const char* p = data.data() + r.offset + sizeof(rec);
+        const char* payloadEnd = data.data() + r.offset + rec.size;
+
+        args.assign(rec.argCount, std::string());
+        bool ok = true;
+        for (auto& arg : args) {
+            if (!decodeArg(p, payloadEnd, arg)) {
+                ok = false;
+                break;
+            }
+        }
+
+        auto it = formats.find(rec.formatId);
+        LogLevel level = (it != formats.end()) ? it->second.level : LogLevel::Info;
+        std::string message = (it != formats.end())
+            ? render(it->second.format, args)
+            : "<未知格式 #" + std::to_string(rec.formatId) + ">";
+        if (!ok) message += " <参数损坏>";
+
+        uint64_t systemNs = header.anchorSystemNs + (rec.timestampNs - header.anchorSteadyNs);
+        std::cout << "[" << levelName(level) << "] " << formatTimestamp(systemNs)
+                  << " [" << serviceName << "] - " << message << "\n";
+        ++rendered;
+    }
+
+    std::cerr << "共 " << rendered << " 条记录";
+    if (oldest > 0) {
+        std::cerr << ", 环形区已回绕, 更早的记录已被覆盖";
+    }
+    if (header.droppedRecords) {
+        std::cerr << ", 因单条记录超过环形区大小丢弃 " << header.droppedRecords << " 条";
+    }
+    std::cerr << std::endl;
+    return 0;
+}
@@ -0,0 +1,355 @@
+// dark-replay: 回放 dark-server 录制的流量, 用于不依赖浏览器的压测和回归对比
+//
+// 用法: dark-replay <record-file> [--http host:port] [--ws ws://host:port] [--speed N] [--concurrency N]
+//
+// 本工具同时扮演两端:
+//   - 假浏览器: 连接 dark-server 的 WebSocket 端口, 收到 proxy_request 后按
+//     method + path + body 找到录制中对应的请求, 按录制时的间隔发回
+//     response_headers / chunk / stream_close 事件 (request_id 换成新的)
+//   - HTTP 客户端: 按录制时的到达间隔 (除以 --speed) 发出原始请求, 统计吞吐和延迟
+
+#include "dark-server.h"
+#include <httplib.h>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace DarkServer;
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct RecordedEvent {
+    uint64_t delayNs;          // 距该请求转发的时间
+    json frame;
+};
+
+struct RecordedExchange {
+    uint64_t startNs = 0;      // 距录制开始的时间
+    std::string method;
+    std::string path;
+    std::string body;
+    httplib::Headers headers;
+    int status = 0;
+    std::vector<RecordedEvent> events;
+};
+
+std::string fingerprint(const std::string& method, const std::string& path, const std::string& body) {
+    return method + '\n' + path + '\n' + std::to_string(std::hash<std::string>{}(body));
+}
+
+bool loadRecording(const char* path, std::vector<RecordedExchange>& exchanges) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "无法打开文件: " << path << std::endl;
+        return false;
+    }
+
+    TrafficRecordFileHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kTrafficRecordMagic, sizeof(header.magic)) != 0 || header.version != 1) {
+        std::cerr << "无法识别的录制文件格式" << std::endl;
+        return false;
+    }
+    in.seekg(header.headerSize);
+
+    std::unordered_map<std::string, size_t> byRequestId;
+    TrafficRecordHeader rec;
+    std::string payload;
+    size_t skipped = 0;
+    // 进程被强制结束时最后一条记录可能不完整, 读到为止
+    while (in.read(reinterpret_cast<char*>(&rec), sizeof(rec))) {
+        payload.resize(rec.payloadSize);
+        if (!in.read(&payload[0], rec.payloadSize)) break;
+
+        json j = json::parse(payload, nullptr, false);
+        if (!j.is_object() || !j.contains("request_id") || !j["request_id"].is_string()) {
+            ++skipped;
+            continue;
+        }
+        std::string requestId = j["request_id"].get<std::string>();
+
+        // 字段类型不对时 value()/get() 会抛 json::type_error, 整条记录跳过;
+        // 所有字段读完才写入 exchanges, 跳过的记录不会留下半条数据
+        try {
+            if (rec.kind == static_cast<uint8_t>(TrafficRecordKind::ProxyRequest)) {
+                RecordedExchange exchange;
+                exchange.startNs = rec.offsetNs;
+                exchange.method = j.value("method", "GET");
+                exchange.path = j.value("path", "/");
+                exchange.body = j.value("body", "");
+                if (j.contains("headers") && j["headers"].is_object()) {
+                    for (const auto& [name, value] : j["headers"].items()) {
+                        if (value.is_string()) exchange.headers.emplace(name, value.get<std::string>());
+                    }
+                }
+                byRequestId[requestId] = exchanges.size();
+                exchanges.push_back(std::move(exchange));
+            } else {
+                auto it = byRequestId.find(requestId);
+                if (it == byRequestId.end()) continue;
+                RecordedExchange& exchange = exchanges[it->second];
+                if (j.value("event_type", "") == "response_headers") {
+                    if (j.contains("status") && !j["status"].is_number_integer()) {
+                        ++skipped;
+                        continue;
+                    }
+                    exchange.status = j.value("status", 200);
+                }
+                exchange.events.push_back(RecordedEvent{rec.offsetNs - exchange.startNs, std::move(j)});
+            }
+        } catch (const json::exception&) {
+            ++skipped;
+        }
+    }
+    if (skipped > 0) {
+        std::cerr << "跳过 " << skipped << " 条格式不正确的记录" << std::endl;
+    }
+    return true;
+}
+
+// 假浏览器: 按时间顺序发出待发送的事件
+class FakeBrowser {
+public:
+    using WSClient = websocketpp::client<websocketpp::config::asio_client>;
+
+    FakeBrowser(const std::vector<RecordedExchange>& exchanges, double speed)
+        : exchanges_(exchanges), speed_(speed) {
+        for (size_t i = 0; i < exchanges_.size(); ++i) {
+            const auto& e = exchanges_[i];
+            pending_[fingerprint(e.method, e.path, e.body)].push_back(i);
+        }
+    }
+
+    bool connect(const std::string& url) {
+        client_.clear_access_channels(websocketpp::log::alevel::all);
+        client_.clear_error_channels(websocketpp::log::elevel::all);
+        client_.init_asio();
+        client_.set_open_handler([this](websocketpp::connection_hdl hdl) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            hdl_ = hdl;
+            connected_ = true;
+            cv_.notify_all();
+        });
+        client_.set_message_handler([this](websocketpp::connection_hdl, WSClient::message_ptr msg) {
+            onProxyRequest(msg->get_payload());
+        });
+
+        websocketpp::lib::error_code ec;
+        auto con = client_.get_connection(url, ec);
+        if (ec) {
+            std::cerr << "WebSocket 地址无效: " << url << std::endl;
+            return false;
+        }
+        client_.connect(con);
+        ioThread_ = std::thread([this]() { client_.run(); });
+        senderThread_ = std::thread([this]() { sendLoop(); });
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cv_.wait_for(lock, std::chrono::seconds(5), [this] { return connected_; });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            cv_.notify_all();
+        }
+        if (senderThread_.joinable()) senderThread_.join();
+        if (connected_) client_.close(hdl_, websocketpp::close::status::normal, "replay done");
+        client_.stop();
+        if (ioThread_.joinable()) ioThread_.join();
+    }
+
+    uint64_t unmatched() const { return unmatched_.load(); }
+
+private:
+    struct Outgoing {
+        Clock::time_point due;
+        std::string payload;
+        bool operator>(const Outgoing& other) const { return due > other.due; }
+    };
+
+    const std::vector<RecordedExchange>& exchanges_;
+    double speed_;
+    WSClient client_;
+    websocketpp::connection_hdl hdl_;
+    std::thread ioThread_;
+    std::thread senderThread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool connected_ = false;
+    bool stopping_ = false;
+    std::map<std::string, std::deque<size_t>> pending_;
+    std::priority_queue<Outgoing, std::vector<Outgoing>, std::greater<Outgoing>> outgoing_;
+    std::atomic<uint64_t> unmatched_{0};
+
+    void onProxyRequest(const std::string& payload) {
+        json request = json::parse(payload, nullptr, false);
+        if (!request.is_object()) return;
+        std::string requestId = request.value("request_id", "");
+        std::string key = fingerprint(request.value("method", ""), request.value("path", ""),
+                                      request.value("body", ""));
+
+        auto now = Clock::now();
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pending_.find(key);
+        if (it == pending_.end() || it->second.empty()) {
+            // 录制中没有对应请求时返回错误, 避免服务端一直等待
+            json error = {{"request_id", requestId}, {"event_type", "error"}, {"status", 502},
+                          {"data", "replay: no recorded response"}};
+            outgoing_.push(Outgoing{now, error.dump()});
+            ++unmatched_;
+        } else {
+            const RecordedExchange& exchange = exchanges_[it->second.front()];
+            it->second.pop_front();
+            for (const auto& event : exchange.events) {
+                json frame = event.frame;
+                frame["request_id"] = requestId;
+                auto delay = std::chrono::nanoseconds(static_cast<int64_t>(event.delayNs / speed_));
+                outgoing_.push(Outgoing{now + delay, frame.dump()});
+            }
+        }
+        cv_.notify_all();
+    }
+
+    void sendLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            if (outgoing_.empty()) {
+                cv_.wait(lock);
+                continue;
+            }
+            if (Clock::now() < outgoing_.top().due) {
+                cv_.wait_until(lock, outgoing_.top().due);
+                continue;
+            }
+            std::string payload = outgoing_.top().payload;
+            outgoing_.pop();
+            lock.unlock();
+            websocketpp::lib::error_code ec;
+            client_.send(hdl_, payload, websocketpp::frame::opcode::text, ec);
+            lock.lock();
+        }
+    }
+};
+
+struct Sample {
+    double latencyMs;
+    size_t bytes;
+    bool ok;
+};
+
+double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) return 0;
+    size_t index = static_cast<size_t>(p * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "用法: " << argv[0]
+                  << " <record-file> [--http host:port] [--ws ws://host:port] [--speed N] [--concurrency N]"
+                  << std::endl;
+        return 2;
+    }
+
+    std::string httpHost = "127.0.0.1";
+    int httpPort = 8889;
+    std::string wsUrl = "ws://127.0.0.1:9998";
+    double speed = 1.0;
+    size_t concurrency = 64;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--http") {
+            size_t colon = value.rfind(':');
+            httpHost = value.substr(0, colon);
+            if (colon != std::string::npos) httpPort = std::stoi(value.substr(colon + 1));
+        } else if (option == "--ws") {
+            wsUrl = value;
+        } else if (option == "--speed") {
+            speed = std::max(0.001, std::stod(value));
+        } else if (option == "--concurrency") {
+            concurrency = std::max<size_t>(1, std::stoul(value));
+        } else {
+            std::cerr << "未知参数: " << option << std::endl;
+            return 2;
+        }
+    }
+
+    std::vector<RecordedExchange> exchanges;
+    if (!loadRecording(argv[1], exchanges)) return 1;
+    std::cerr << "载入 " << exchanges.size() << " 个请求" << std::endl;
+
+    FakeBrowser browser(exchanges, speed);
+    if (!browser.connect(wsUrl)) {
+        std::cerr << "无法连接 WebSocket: " << wsUrl << std::endl;
+        return 1;
+    }
+
+    // 按录制的到达时间发出请求, 并发上限内由工作线程领取
+    std::vector<Sample> samples(exchanges.size());
+    std::atomic<size_t> next{0};
+    auto begin = Clock::now();
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < std::min(concurrency, exchanges.size()); ++w) {
+        workers.emplace_back([&]() {
+            httplib::Client client(httpHost, httpPort);
+            for (size_t i = next++; i < exchanges.size(); i = next++) {
+                const RecordedExchange& exchange = exchanges[i];
+                std::this_thread::sleep_until(
+                    begin + std::chrono::nanoseconds(static_cast<int64_t>(exchange.startNs / speed)));
+
+                httplib::Request req;
+                req.method = exchange.method;
+                req.path = exchange.path;
+                req.headers = exchange.headers;
+                req.body = exchange.body;
+
+                auto sent = Clock::now();
+                auto result = client.send(req);
+                double latencyMs = std::chrono::duration<double, std::milli>(Clock::now() - sent).count();
+                bool ok = result && (exchange.status == 0 || result->status == exchange.status);
+                samples[i] = Sample{latencyMs, result ? result->body.size() : 0, ok};
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+    browser.stop();
+
+    std::vector<double> latencies;
+    size_t failures = 0;
+    size_t bytes = 0;
+    for (const auto& sample : samples) {
+        latencies.push_back(sample.latencyMs);
+        bytes += sample.bytes;
+        if (!sample.ok) ++failures;
+    }
+
+    std::printf("requests     %zu (失败 %zu, 未匹配 %llu)\n", samples.size(), failures,
+                static_cast<unsigned long long>(browser.unmatched()));
+    std::printf("elapsed      %.3f s\n", elapsed);
+    std::printf("throughput   %.1f req/s, %.2f MB/s\n", samples.size() / elapsed, bytes / elapsed / 1e6);
+    std::printf("latency ms   p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", percentile(latencies, 0.50),
+                percentile(latencies, 0.90), percentile(latencies, 0.99), percentile(latencies, 1.0));
+    return failures ? 1 : 0;
+}
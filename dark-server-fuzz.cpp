@@ -0,0 +1,276 @@
+// dark-server-fuzz: 浏览器消息解析器 (ConnectionRegistry::handleIncomingMessage) 的模糊测试和畸形消息压测
+//
+// libFuzzer (需要 clang):
+//   clang++ -std=c++17 -O1 -g -fsanitize=fuzzer,address,undefined -DDARK_SERVER_NO_MAIN -DDARK_SERVER_LIBFUZZER dark-server-fuzz.cpp dark-server.cpp -o dark-server-fuzz -lpthread
+//   ./dark-server-fuzz corpus/
+//
+// 独立模式 (不依赖 libFuzzer):
+//   g++ -std=c++17 -O2 -DDARK_SERVER_NO_MAIN dark-server-fuzz.cpp dark-server.cpp -o dark-server-fuzz -lpthread
+//   ./dark-server-fuzz --properties 100000    生成随机合法消息和变异消息, 检查下面的性质
+//   ./dark-server-fuzz --flood 2              各类畸形消息的处理耗时, 与合法消息对比
+//   ./dark-server-fuzz file...                重放 libFuzzer 保存的输入
+//
+// 每个输入都检查的性质:
+//   - 不崩溃、不抛异常 (由 sanitizer 检查越界)
+//   - 与 nlohmann::json 差分: nlohmann 认为合法的消息 (request_id / event_type / data 为字符串,
+//     status 为 int 范围内的整数), 解析器必须接受, 且 data、status 和字符串响应头与 nlohmann 一致
+
+#include "dark-server.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace DarkServer;
+using json = nlohmann::json;
+
+namespace {
+
+constexpr const char* kRequestId = "r1";
+
+// 把内置事件的处理器换成记录器, 只观察解析结果
+struct FuzzTarget {
+    std::shared_ptr<LoggingService> logger = std::make_shared<LoggingService>("Fuzz");
+    std::shared_ptr<ConnectionRegistry> registry = std::make_shared<ConnectionRegistry>(logger);
+    std::shared_ptr<MessageQueue> queue;
+    bool captured = false;
+    Message last;
+
+    FuzzTarget() {
+        logger->setLevel(LogLevel::Error);
+        queue = registry->createMessageQueue(kRequestId);
+        for (const char* name : {"response_headers", "chunk", "stream_close", "error"}) {
+            registry->registerEventHandler(name, [this](Message&& message, const std::shared_ptr<MessageQueue>&) {
+                captured = true;
+                last = std::move(message);
+            });
+        }
+    }
+
+    bool feed(const char* data, size_t size) {
+        captured = false;
+        registry->handleIncomingMessage(std::make_shared<std::string>(data, size));
+        return captured;
+    }
+};
+
+FuzzTarget& target() {
+    static FuzzTarget instance;
+    return instance;
+}
+
+[[noreturn]] void fail(const std::string& what, const char* data, size_t size) {
+    std::cerr << "性质不成立: " << what << "\n输入 (" << size << " 字节): " << std::string(data, size) << std::endl;
+    std::abort();
+}
+
+// nlohmann 能无歧义表达、解析器必须接受的消息
+bool expectAccepted(const json& j) {
+    if (!j.is_object()) return false;
+    auto id = j.find("request_id");
+    auto event = j.find("event_type");
+    if (id == j.end() || !id->is_string() || *id != kRequestId) return false;
+    if (event == j.end() || !event->is_string()) return false;
+    const std::string& name = event->get_ref<const std::string&>();
+    if (name != "response_headers" && name != "chunk" && name != "stream_close" && name != "error") return false;
+    if (j.contains("data") && !j["data"].is_string()) return false;
+    if (j.contains("status")) {
+        const json& status = j["status"];
+        if (!status.is_number_integer()) return false;
+        if (status.is_number_unsigned() ? status.get<uint64_t>() > INT32_MAX
+                                         : (status.get<int64_t>() < INT32_MIN || status.get<int64_t>() > INT32_MAX)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void checkInput(const char* data, size_t size) {
+    FuzzTarget& t = target();
+    bool accepted = t.feed(data, size);
+
+    if (accepted && t.last.payload.size() > size) fail("data 超出帧的范围", data, size);
+
+    // nlohmann 会跳过 UTF-8 BOM, 浏览器消息不会带 BOM, 不做对照
+    if (size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0) return;
+    json j = json::parse(data, data + size, nullptr, false);
+    if (j.is_discarded() || !expectAccepted(j)) return;
+
+    if (!accepted) fail("合法消息被拒绝", data, size);
+    std::string expectedData = j.value("data", "");
+    if (t.last.payload.str() != expectedData) fail("data 与 nlohmann 不一致", data, size);
+    if (t.last.status != j.value("status", 200)) fail("status 与 nlohmann 不一致", data, size);
+    if (j.contains("headers") && j["headers"].is_object()) {
+        for (const auto& [name, value] : j["headers"].items()) {
+            if (!value.is_string()) continue;
+            auto it = t.last.headers.find(name);
+            if (it == t.last.headers.end() || it->second != value.get<std::string>()) {
+                fail("响应头 " + name + " 与 nlohmann 不一致", data, size);
+            }
+        }
+    }
+}
+
+// 随机合法消息: 字段顺序、空白、无关字段和字符串内容 (含转义和 \u 序列) 都随机
+class MessageGenerator {
+public:
+    explicit MessageGenerator(uint64_t seed) : rng_(seed) {}
+
+    std::string next() {
+        json j;
+        j["request_id"] = kRequestId;
+        j["event_type"] = pick({"response_headers", "chunk", "stream_close", "error"});
+        if (coin()) j["data"] = randomString(range(0, 256));
+        if (coin()) j["status"] = static_cast<int>(range(0, 999)) - (coin() ? 0 : 500);
+        if (coin()) {
+            json headers = json::object();
+            for (size_t i = range(0, 4); i > 0; --i) {
+                headers[randomString(range(1, 12))] = coin() ? json(randomString(range(0, 24))) : json(range(0, 9));
+            }
+            j["headers"] = headers;
+        }
+        if (coin()) j["extra"] = json::parse(R"({"a":[1,"}\"]",{"b":null}],"c":true})");
+
+        // 手工拼接, 让字段顺序和空白随机, 并用 \u 转义部分字段名
+        std::vector<std::string> fields;
+        for (const auto& [key, value] : j.items()) {
+            std::string name = json(key).dump();
+            if (coin() && key == "data") name = "\"\\u0064ata\"";
+            fields.push_back(name + space() + ":" + space() + value.dump());
+        }
+        std::shuffle(fields.begin(), fields.end(), rng_);
+        std::string out = space() + "{" + space();
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (i) out += space() + "," + space();
+            out += fields[i];
+        }
+        return out + space() + "}" + space();
+    }
+
+    // 对合法消息做随机的字节级变异
+    std::string mutate(std::string message) {
+        for (size_t n = range(1, 4); n > 0 && !message.empty(); --n) {
+            size_t pos = range(0, message.size() - 1);
+            switch (range(0, 3)) {
+            case 0: message[pos] = static_cast<char>(range(0, 255)); break;
+            case 1: message.erase(pos, range(1, 8)); break;
+            case 2: message.insert(pos, pick({"\"", "\\", "{", "}", ",", ":", "\\u", "[", "]", "\\ud800"})); break;
+            default: message.resize(pos); break;
+            }
+        }
+        return message;
+    }
+
+private:
+    std::mt19937_64 rng_;
+
+    size_t range(size_t lo, size_t hi) { return std::uniform_int_distribution<size_t>(lo, hi)(rng_); }
+    bool coin() { return range(0, 1) == 1; }
+    const char* pick(std::initializer_list<const char*> options) { return options.begin()[range(0, options.size() - 1)]; }
+    std::string space() { return pick({"", "", " ", "\n", "\t ", "\r\n"}); }
+
+    std::string randomString(size_t length) {
+        static const char* pieces[] = {"a", "Z", "0", " ", "\"", "\\", "/", "\n", "\t", "{", "}", "中", "é", "😀",
+                                       "data: x\n\n", "\x01"};
+        std::string out;
+        while (out.size() < length) out += pieces[range(0, std::size(pieces) - 1)];
+        return out;
+    }
+};
+
+int runProperties(uint64_t iterations) {
+    MessageGenerator generator(20240601);
+    uint64_t accepted = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        std::string message = generator.next();
+        checkInput(message.data(), message.size());
+        accepted += target().captured;
+        std::string mutated = generator.mutate(message);
+        checkInput(mutated.data(), mutated.size());
+    }
+    std::cout << "性质检查通过: " << iterations << " 条合法消息 (接受 " << accepted << "), "
+              << iterations << " 条变异消息" << std::endl;
+    return 0;
+}
+
+// 畸形消息洪泛: 每类消息的单条处理时间应与合法消息同级
+int runFlood(double seconds) {
+    std::string big(64 * 1024, 'x');
+    std::string escaped;
+    while (escaped.size() < 64 * 1024) escaped += "ab\\n";
+    std::vector<std::pair<std::string, std::string>> cases = {
+        {"合法 chunk (1KB)", R"({"request_id":"r1","event_type":"chunk","data":")" + std::string(1024, 'x') + "\"}"},
+        {"合法 chunk (64KB 转义)", R"({"request_id":"r1","event_type":"chunk","data":")" + escaped + "\"}"},
+        {"未知请求ID", R"({"request_id":"nope","event_type":"chunk","data":"x"})"},
+        {"未知事件", R"({"request_id":"r1","event_type":"bogus","data":"x"})"},
+        {"不是对象", "[1,2,3]"},
+        {"status 不是整数", R"({"request_id":"r1","event_type":"chunk","status":"200"})"},
+        {"data 不是字符串", R"({"request_id":"r1","event_type":"chunk","data":{"a":1}})"},
+        {"字符串未结束 (64KB)", R"({"request_id":"r1","event_type":"chunk","data":")" + big},
+        {"转义未结束 (64KB)", R"({"request_id":"r1","event_type":"chunk","data":")" + escaped},
+        {"深层嵌套 (64KB)", R"({"x":)" + std::string(32 * 1024, '[') + std::string(32 * 1024, ']') + "}"},
+        {"无效转义", R"({"request_id":"r1","event_type":"chunk","data":"\q"})"},
+        {"缺少 request_id", R"({"event_type":"chunk","data":"x"})"},
+    };
+
+    FuzzTarget& t = target();
+    for (const auto& [name, message] : cases) {
+        uint64_t count = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto stop = start + std::chrono::duration<double>(seconds / cases.size());
+        while (std::chrono::steady_clock::now() < stop) {
+            for (int i = 0; i < 64; ++i) t.feed(message.data(), message.size());
+            count += 64;
+        }
+        double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%-28s %8zu 字节  %10.0f ns/条  %8.1f MB/s\n", name.c_str(), message.size(), elapsedNs / count,
+                    message.size() * count / elapsedNs * 1e3);
+    }
+
+    const FrameParseStats& stats = t.registry->parseStats();
+    std::printf("接受 %llu 条, 丢弃 %llu 条\n", static_cast<unsigned long long>(stats.accepted.load()),
+                static_cast<unsigned long long>(stats.rejectedTotal()));
+    for (size_t i = 1; i < static_cast<size_t>(FrameError::Count); ++i) {
+        if (uint64_t n = stats.rejected[i].load()) {
+            std::printf("  %-20s %llu\n", frameErrorName(static_cast<FrameError>(i)), static_cast<unsigned long long>(n));
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    checkInput(reinterpret_cast<const char*>(data), size);
+    return 0;
+}
+
+#ifndef DARK_SERVER_LIBFUZZER
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && std::string(argv[1]) == "--properties") {
+        return runProperties(argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 100000);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--flood") {
+        return runFlood(argc >= 3 ? std::atof(argv[2]) : 2.0);
+    }
+    if (argc < 2) {
+        std::cerr << "用法: " << argv[0] << " --properties [N] | --flood [seconds] | file..." << std::endl;
+        return 2;
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::ifstream in(argv[i], std::ios::binary);
+        std::string input((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        checkInput(input.data(), input.size());
+    }
+    std::cout << "重放 " << (argc - 1) << " 个输入, 未发现问题" << std::endl;
+    return 0;
+}
+#endif
@@ -1,21 +1,265 @@
 #include "dark-server.h"
+#ifdef DARK_SERVER_TLS
+#ifndef CPPHTTPLIB_OPENSSL_SUPPORT
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#endif
+#endif
 #include <httplib.h>
 #include <websocketpp/config/asio_no_tls.hpp>
+#ifdef DARK_SERVER_TLS
+#include <websocketpp/config/asio.hpp>
+#include <openssl/ssl.h>
+#endif
 #include <websocketpp/server.hpp>
 #include <nlohmann/json.hpp>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <random>
+#include <fstream>
+#include <csignal>
+#include <cctype>
+#include <charconv>
+#include <cassert>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
 
 using json = nlohmann::json;
 using namespace std::chrono;
 
 namespace DarkServer {
 
+const char* logLevelName(LogLevel level) {
+    switch (level) {
+    case LogLevel::Debug: return "DEBUG";
+    case LogLevel::Info: return "INFO";
+    case LogLevel::Warn: return "WARN";
+    case LogLevel::Error: return "ERROR";
+    }
+    return "INFO";
+}
+
+static uint64_t steadyNowNs() {
+    return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+// LogFormatRegistry 实现
+LogFormatRegistry& LogFormatRegistry::instance() {
+    static LogFormatRegistry registry;
+    return registry;
+}
+
+uint16_t LogFormatRegistry::registerFormat(LogLevel level, const char* format) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.size() >= kMaxFormats) {
+        throw std::runtime_error("日志格式数量超过上限");
+    }
+    entries_.push_back(Entry{level, format});
+    return static_cast<uint16_t>(entries_.size() - 1);
+}
+
+LogLevel LogFormatRegistry::level(uint16_t formatId) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.at(formatId).level;
+}
+
+const char* LogFormatRegistry::format(uint16_t formatId) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.at(formatId).format;
+}
+
+// BinaryLogWriter 实现
+static constexpr size_t kBinaryLogAlign = 8;
+// 格式区上限; 格式字符串来自调用点的字面量, 这个大小足以容纳全部格式
+static constexpr size_t kBinaryLogFormatArea = 256 * 1024;
+
+static size_t alignRecord(size_t size) {
+    return (size + kBinaryLogAlign - 1) & ~(kBinaryLogAlign - 1);
+}
+
+BinaryLogWriter::BinaryLogWriter(const std::string& path, size_t capacityBytes, const std::string& serviceName)
+    : path_(path), capacity_(alignRecord(capacityBytes)),
+      formatWritten_(new std::atomic<bool>[LogFormatRegistry::kMaxFormats]) {
+    for (size_t i = 0; i < LogFormatRegistry::kMaxFormats; ++i) {
+        formatWritten_[i].store(false, std::memory_order_relaxed);
+    }
+    size_t formatArea = alignRecord(std::min(capacity_ / 16, kBinaryLogFormatArea));
+    formatAreaEnd_ = alignRecord(sizeof(BinaryLogFileHeader)) + formatArea;
+    if (capacity_ <= formatAreaEnd_ + sizeof(BinaryLogRecordHeader)) {
+        throw std::runtime_error("二进制日志容量过小");
+    }
+    ringSize_ = capacity_ - formatAreaEnd_;
+
+#ifndef _WIN32
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("无法打开二进制日志文件: " + path);
+    }
+    if (::ftruncate(fd_, static_cast<off_t>(capacity_)) != 0) {
+        ::close(fd_);
+        throw std::runtime_error("无法分配二进制日志文件: " + path);
+    }
+    void* mapped = ::mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapped == MAP_FAILED) {
+        ::close(fd_);
+        throw std::runtime_error("无法映射二进制日志文件: " + path);
+    }
+    base_ = static_cast<char*>(mapped);
+#else
+    // 没有 mmap 时写入内存缓冲, 关闭时整体落盘
+    base_ = new char[capacity_]();
+#endif
+
+    BinaryLogFileHeader header{};
+    std::memcpy(header.magic, kBinaryLogMagic, sizeof(header.magic));
+    header.version = 2;
+    header.headerSize = sizeof(BinaryLogFileHeader);
+    header.capacity = capacity_;
+    header.formatAreaEnd = formatAreaEnd_;
+    header.anchorSteadyNs = steadyNowNs();
+    header.anchorSystemNs = static_cast<uint64_t>(
+        duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
+    std::strncpy(header.serviceName, serviceName.c_str(), sizeof(header.serviceName) - 1);
+    std::memcpy(base_, &header, sizeof(header));
+    formatOffset_.store(alignRecord(sizeof(BinaryLogFileHeader)), std::memory_order_relaxed);
+}
+
+BinaryLogWriter::~BinaryLogWriter() {
+    if (!base_) return;
+
+    uint64_t position = position_.load();
+    auto* header = reinterpret_cast<BinaryLogFileHeader*>(base_);
+    header->writePosition = position;
+    header->droppedRecords = dropped_.load();
+    // 环形区还没写满一圈时截掉未用的部分
+    size_t used = position < ringSize_ ? formatAreaEnd_ + static_cast<size_t>(position) : capacity_;
+
+#ifndef _WIN32
+    ::msync(base_, used, MS_SYNC);
+    ::munmap(base_, capacity_);
+    if (::ftruncate(fd_, static_cast<off_t>(used)) != 0) {
+        // 截断失败不影响解码, 未写过的部分全为 0, 解码器会跳过
+    }
+    ::close(fd_);
+#else
+    std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+    out.write(base_, static_cast<std::streamsize>(used));
+    delete[] base_;
+#endif
+    base_ = nullptr;
+}
+
+char* BinaryLogWriter::allocate(size_t recordSize, uint64_t& sequence) {
+    size_t size = alignRecord(recordSize);
+    if (size > ringSize_) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    // 记录不跨越环形区末尾: 剩余空间放不下时从下一圈开头分配, 末尾剩下的
+    // 旧记录的 sequence 已落在最近一圈之外, 解码器会把它们当作过期数据。
+    // 写入中的线程被整整一圈的新日志追上时这条记录会损坏, 64MB 的环形区下可忽略
+    uint64_t position = position_.load(std::memory_order_relaxed);
+    uint64_t start;
+    do {
+        size_t offset = static_cast<size_t>(position % ringSize_);
+        start = (offset + size > ringSize_) ? position + (ringSize_ - offset) : position;
+    } while (!position_.compare_exchange_weak(position, start + size, std::memory_order_relaxed));
+    sequence = start;
+    return base_ + formatAreaEnd_ + static_cast<size_t>(start % ringSize_);
+}
+
+void BinaryLogWriter::writeFormatRecord(uint16_t formatId) {
+    auto& registry = LogFormatRegistry::instance();
+    const char* format = registry.format(formatId);
+    size_t formatLen = std::strlen(format);
+    size_t payloadSize = 1 + formatLen;
+
+    // 格式记录写入格式区, 不会被环形区覆盖; 格式区写满时才退回环形区
+    size_t size = alignRecord(sizeof(BinaryLogRecordHeader) + payloadSize);
+    size_t offset = formatOffset_.fetch_add(size, std::memory_order_relaxed);
+    uint64_t sequence = 0;
+    char* record = nullptr;
+    if (offset + size <= formatAreaEnd_) {
+        record = base_ + offset;
+    } else {
+        record = allocate(sizeof(BinaryLogRecordHeader) + payloadSize, sequence);
+        if (!record) return;
+    }
+
+    BinaryLogRecordHeader header{};
+    header.formatId = formatId;
+    header.kind = static_cast<uint8_t>(BinaryLogRecordKind::Format);
+    header.timestampNs = steadyNowNs();
+    header.sequence = sequence;
+    std::memcpy(record, &header, sizeof(header));
+    record[sizeof(header)] = static_cast<char>(registry.level(formatId));
+    std::memcpy(record + sizeof(header) + 1, format, formatLen);
+    commit(record, payloadSize);
+}
+
+char* BinaryLogWriter::reserve(uint16_t formatId, uint8_t argCount, size_t payloadSize) {
+    // 格式定义在本文件中首次使用时写入, 解码器会先收集全部格式再渲染
+    if (!formatWritten_[formatId].load(std::memory_order_relaxed) &&
+        !formatWritten_[formatId].exchange(true)) {
+        writeFormatRecord(formatId);
+    }
+
+    uint64_t sequence = 0;
+    char* record = allocate(sizeof(BinaryLogRecordHeader) + payloadSize, sequence);
+    if (!record) return nullptr;
+
+    BinaryLogRecordHeader header{};
+    header.formatId = formatId;
+    header.kind = static_cast<uint8_t>(BinaryLogRecordKind::Event);
+    header.argCount = argCount;
+    header.timestampNs = steadyNowNs();
+    header.sequence = sequence;
+    std::memcpy(record, &header, sizeof(header));
+    return record;
+}
+
+void BinaryLogWriter::commit(char* record, size_t payloadSize) {
+    // size 最后发布, 崩溃时未完成的记录 size 为 0
+    uint32_t size = static_cast<uint32_t>(sizeof(BinaryLogRecordHeader) + payloadSize);
+    reinterpret_cast<std::atomic<uint32_t>*>(record)->store(size, std::memory_order_release);
+}
+
 // LoggingService 实现
 LoggingService::LoggingService(const std::string& serviceName) : serviceName_(serviceName) {}
 
+bool LoggingService::enableBinaryLog(const std::string& path, size_t capacityBytes) {
+    // 仅在启动阶段调用, 此时尚无其他线程写日志
+    try {
+        binaryLogOwner_ = std::make_unique<BinaryLogWriter>(path, capacityBytes, serviceName_);
+    } catch (const std::exception& e) {
+        error("启用二进制日志失败: " + std::string(e.what()));
+        return false;
+    }
+    binaryLog_ = binaryLogOwner_.get();
+    return true;
+}
+
+void LoggingService::disableBinaryLog() {
+    binaryLog_ = nullptr;
+    binaryLogOwner_.reset();
+}
+
 std::string LoggingService::formatMessage(const std::string& level, const std::string& message) {
     auto now = system_clock::now();
     auto time_t = system_clock::to_time_t(now);
@@ -29,20 +273,258 @@ std::string LoggingService::formatMessage(const std::string& level, const std::s
     return ss.str();
 }
 
+void LoggingService::writeText(LogLevel level, const std::string& message) {
+    std::ostream& out = (level == LogLevel::Error) ? std::cerr : std::cout;
+    out << formatMessage(logLevelName(level), message) << std::endl;
+}
+
 void LoggingService::info(const std::string& message) {
-    std::cout << formatMessage("INFO", message) << std::endl;
+    DARK_LOG(this, LogLevel::Info, "{}", message);
 }
 
 void LoggingService::error(const std::string& message) {
-    std::cerr << formatMessage("ERROR", message) << std::endl;
+    DARK_LOG(this, LogLevel::Error, "{}", message);
 }
 
 void LoggingService::warn(const std::string& message) {
-    std::cout << formatMessage("WARN", message) << std::endl;
+    DARK_LOG(this, LogLevel::Warn, "{}", message);
 }
 
 void LoggingService::debug(const std::string& message) {
-    std::cout << formatMessage("DEBUG", message) << std::endl;
+    DARK_LOG(this, LogLevel::Debug, "{}", message);
+}
+
+// RequestTracer 实现
+const char* traceStageName(TraceStage stage) {
+    switch (stage) {
+    case TraceStage::Accept: return "accept";
+    case TraceStage::BuildProxyRequest: return "build_proxy_request";
+    case TraceStage::WebSocketSend: return "websocket_send";
+    case TraceStage::ResponseHeaders: return "response_headers";
+    case TraceStage::Chunk: return "chunk";
+    case TraceStage::StreamEnd: return "stream_end";
+    case TraceStage::ResponseComplete: return "response_complete";
+    }
+    return "unknown";
+}
+
+static std::atomic<uint64_t> nextTracerId{1};
+static std::atomic<uint32_t> nextTraceThreadId{1};
+
+RequestTracer::RequestTracer(uint32_t sampleEvery, size_t ringCapacity)
+    : sampleEvery_(sampleEvery), ringCapacity_(std::max<size_t>(ringCapacity, 16)),
+      tracerId_(nextTracerId.fetch_add(1)) {}
+
+bool RequestTracer::sampled(const std::string& requestId) const {
+    uint32_t every = sampleEvery_.load(std::memory_order_relaxed);
+    if (every == 0) return false;
+    return std::hash<std::string>{}(requestId) % every == 0;
+}
+
+RequestTracer::ThreadRing& RequestTracer::localRing() {
+    struct LocalRing {
+        uint64_t tracerId = 0;
+        std::shared_ptr<ThreadRing> ring;
+    };
+    thread_local LocalRing local;
+    thread_local uint32_t threadId = nextTraceThreadId.fetch_add(1);
+
+    if (local.tracerId != tracerId_) {
+        local.ring = std::make_shared<ThreadRing>(ringCapacity_, threadId);
+        local.tracerId = tracerId_;
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        rings_.push_back(local.ring);
+    }
+    return *local.ring;
+}
+
+void RequestTracer::record(const std::string& requestId, TraceStage stage) {
+    if (!sampled(requestId)) return;
+    writeEvent(requestId, stage, steadyNowNs());
+}
+
+void RequestTracer::record(const std::string& requestId, TraceStage stage, uint64_t timestampNs) {
+    if (!sampled(requestId)) return;
+    writeEvent(requestId, stage, timestampNs);
+}
+
+void RequestTracer::writeEvent(const std::string& requestId, TraceStage stage, uint64_t timestampNs) {
+    ThreadRing& ring = localRing();
+    Slot& slot = ring.slots[ring.head % ring.slots.size()];
+    ring.head++;
+
+    // 序号为奇数期间导出线程会跳过该槽位
+    uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.event.timestampNs = timestampNs;
+    slot.event.threadId = ring.threadId;
+    slot.event.stage = stage;
+    size_t len = std::min(requestId.size(), sizeof(slot.event.requestId) - 1);
+    std::memcpy(slot.event.requestId, requestId.data(), len);
+    slot.event.requestId[len] = '\0';
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+std::string RequestTracer::dumpChromeTrace() const {
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        rings = rings_;
+    }
+
+    json events = json::array();
+    for (const auto& ring : rings) {
+        for (const Slot& slot : ring->slots) {
+            uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            if (before == 0 || (before & 1)) continue;
+            TraceEvent event = slot.event;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != before) continue;
+
+            double ts = static_cast<double>(event.timestampNs) / 1000.0;
+            std::string requestId(event.requestId);
+
+            // 同一请求的各阶段归入一条异步轨道, accept/complete 作为起止
+            json item;
+            item["name"] = traceStageName(event.stage);
+            item["cat"] = "proxy";
+            item["ts"] = ts;
+            item["pid"] = 1;
+            item["tid"] = event.threadId;
+            item["id"] = requestId;
+            item["args"] = {{"request_id", requestId}};
+            item["ph"] = "n";
+            if (event.stage == TraceStage::Accept) {
+                json begin = item;
+                begin["name"] = "request";
+                begin["ph"] = "b";
+                events.push_back(begin);
+            }
+            events.push_back(item);
+            if (event.stage == TraceStage::ResponseComplete) {
+                json end = item;
+                end["name"] = "request";
+                end["ph"] = "e";
+                events.push_back(end);
+            }
+        }
+    }
+
+    json trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = "ms";
+    return trace.dump();
+}
+
+// RateLimiter 实现
+static uint64_t mixHash(uint64_t x) {
+    // splitmix64 末端混合, 让低位和高位都均匀
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static size_t roundUpPow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+RateLimiter::RateLimiter(double ratePerSecond, double burst, std::string keyHeader,
+                         size_t shardCount, size_t bucketsPerShard)
+    : ratePerSecond_(0), burstMilli_(0), keyHeader_(std::move(keyHeader)),
+      shardMask_(roundUpPow2(shardCount) - 1), bucketMask_(roundUpPow2(bucketsPerShard) - 1),
+      shards_(new Shard[shardMask_ + 1]), epoch_(steady_clock::now()) {
+    for (size_t i = 0; i <= shardMask_; ++i) {
+        shards_[i].buckets.reset(new Bucket[bucketMask_ + 1]);
+    }
+    setLimits(ratePerSecond, burst);
+}
+
+void RateLimiter::setLimits(double ratePerSecond, double burst) {
+    double burstMilli = std::max(1.0, burst) * kMilliPerToken;
+    burstMilli_.store(static_cast<uint64_t>(std::min<double>(burstMilli, kTokenMask)), std::memory_order_relaxed);
+    ratePerSecond_.store(std::max(0.0, ratePerSecond), std::memory_order_relaxed);
+}
+
+RateLimiter::Bucket* RateLimiter::findBucket(uint64_t hash, uint64_t nowMs, double rate, uint64_t burstMilli) {
+    Shard& shard = shards_[(hash >> 40) & shardMask_];
+    // 超过该时长未访问的桶必然已补满, 与新桶等价, 可以被其他键复用
+    uint64_t idleMs = static_cast<uint64_t>(burstMilli / rate) + 1000;
+
+    for (size_t probe = 0; probe < kMaxProbe; ++probe) {
+        Bucket& bucket = shard.buckets[(hash + probe) & bucketMask_];
+        uint64_t key = bucket.key.load(std::memory_order_acquire);
+        if (key == hash) return &bucket;
+
+        if (key == 0) {
+            if (bucket.key.compare_exchange_strong(key, hash, std::memory_order_acq_rel)) return &bucket;
+            if (key == hash) return &bucket;
+            continue;
+        }
+
+        uint64_t state = bucket.state.load(std::memory_order_relaxed);
+        uint64_t lastMs = state >> kTokenBits;
+        if (nowMs > lastMs + idleMs && bucket.key.compare_exchange_strong(key, hash, std::memory_order_acq_rel)) {
+            bucket.state.store(0, std::memory_order_relaxed);
+            return &bucket;
+        }
+    }
+    return nullptr;
+}
+
+bool RateLimiter::allow(std::string_view key, uint64_t* retryAfterMs) {
+    double rate = ratePerSecond_.load(std::memory_order_relaxed);
+    if (rate <= 0) return true;
+
+    uint64_t hash = mixHash(std::hash<std::string_view>{}(key)) | 1;
+    uint64_t nowMs = static_cast<uint64_t>(duration_cast<milliseconds>(steady_clock::now() - epoch_).count()) + 1;
+    uint64_t burstMilli = burstMilli_.load(std::memory_order_relaxed);
+    Bucket* bucket = findBucket(hash, nowMs, rate, burstMilli);
+    if (!bucket) {
+        // 探测范围内没有空位时放行, 宁可少限也不让限流器成为瓶颈
+        overflow_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 每毫秒补充的千分之一令牌数恰好等于每秒令牌数
+    uint64_t state = bucket->state.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t tokens = burstMilli;
+        if (state != 0) {
+            uint64_t lastMs = state >> kTokenBits;
+            uint64_t elapsedMs = nowMs > lastMs ? nowMs - lastMs : 0;
+            double refilled = static_cast<double>(state & kTokenMask) + static_cast<double>(elapsedMs) * rate;
+            tokens = static_cast<uint64_t>(std::min<double>(refilled, burstMilli));
+        }
+
+        if (tokens < kMilliPerToken) {
+            if (retryAfterMs) {
+                *retryAfterMs = static_cast<uint64_t>((kMilliPerToken - tokens) / rate) + 1;
+            }
+            return false;
+        }
+
+        uint64_t next = (nowMs << kTokenBits) | (tokens - kMilliPerToken);
+        if (bucket->state.compare_exchange_weak(state, next, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+bool RateLimiter::allowRequest(const httplib::Request& req, uint64_t* retryAfterMs) {
+    if (!enabled()) return true;
+
+    if (!keyHeader_.empty() && req.has_header(keyHeader_)) {
+        return allow("h:" + req.get_header_value(keyHeader_), retryAfterMs);
+    }
+    return allow("ip:" + req.remote_addr, retryAfterMs);
 }
 
 // MessageQueue 实现
@@ -53,63 +535,100 @@ MessageQueue::~MessageQueue() {
 }
 
 void MessageQueue::enqueue(const Message& message) {
+    enqueue(Message(message));
+}
+
+void MessageQueue::enqueue(Message&& message) {
     std::lock_guard<std::mutex> lock(mutex_);
     if (closed_) return;
-    
-    if (!waitingPromises_.empty()) {
-        auto promise = std::move(waitingPromises_.front());
-        waitingPromises_.pop();
-        promise.set_value(message);
-    } else {
-        messages_.push(message);
+
+    messages_.push(std::move(message));
+    cv_.notify_one();
+}
+
+Message MessageQueue::pop(std::chrono::milliseconds timeoutMs) {
+    auto timeout = (timeoutMs.count() == 0) ? defaultTimeout_ : timeoutMs;
+    Message message;
+    if (!popUntil(message, steady_clock::now() + timeout)) {
+        throw std::runtime_error("Queue timeout");
     }
+    return message;
 }
 
-std::future<Message> MessageQueue::dequeue(std::chrono::milliseconds timeoutMs) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    if (closed_) {
-        std::promise<Message> promise;
-        promise.set_exception(std::make_exception_ptr(std::runtime_error("Queue is closed")));
-        return promise.get_future();
+bool MessageQueue::popUntil(Message& message, std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (!cv_.wait_until(lock, deadline, [this] { return closed_ || !messages_.empty(); })) {
+        return false;
     }
-    
-    if (!messages_.empty()) {
-        auto message = messages_.front();
-        messages_.pop();
-        std::promise<Message> promise;
-        promise.set_value(message);
-        return promise.get_future();
+    if (closed_) {
+        throw std::runtime_error("Queue closed");
     }
-    
-    std::promise<Message> promise;
-    auto future = promise.get_future();
-    waitingPromises_.push(std::move(promise));
-    
-    // 设置超时处理
-    auto timeout = (timeoutMs.count() == 0) ? defaultTimeout_ : timeoutMs;
-    std::thread([this, timeout, &future]() {
-        if (future.wait_for(timeout) == std::future_status::timeout) {
-            std::lock_guard<std::mutex> lock(mutex_);
-            // 超时处理逻辑
+
+    message = std::move(messages_.front());
+    messages_.pop();
+    return true;
+}
+
+void MessageQueue::setOwner(websocketpp::connection_hdl owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    owner_ = std::move(owner);
+}
+
+websocketpp::connection_hdl MessageQueue::takeOwner() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::exchange(owner_, websocketpp::connection_hdl());
+}
+
+// SseCoalescer 实现
+void SseCoalescer::append(const char* data, size_t size) {
+    buffer_.append(data, size);
+
+    // 事件以空行结束, 行结束符可以是 \n、\r\n 或 \r
+    size_t i = scanFrom_;
+    size_t n = buffer_.size();
+    for (; i < n; ++i) {
+        char c = buffer_[i];
+        if (c != '\r' && c != '\n') {
+            atLineStart_ = false;
+            continue;
         }
-    }).detach();
-    
-    return future;
+        if (c == '\r') {
+            if (i + 1 == n) break;           // 可能是 \r\n 的前半, 等下一块再判断
+            if (buffer_[i + 1] == '\n') ++i;
+        }
+        if (atLineStart_) {
+            completeEnd_ = i + 1;
+        }
+        atLineStart_ = true;
+    }
+    scanFrom_ = i;
+}
+
+std::string SseCoalescer::takeCompleteEvents() {
+    std::string events = buffer_.substr(0, completeEnd_);
+    buffer_.erase(0, completeEnd_);
+    scanFrom_ -= completeEnd_;
+    completeEnd_ = 0;
+    return events;
+}
+
+std::string SseCoalescer::takeAll() {
+    std::string all;
+    all.swap(buffer_);
+    completeEnd_ = 0;
+    scanFrom_ = 0;
+    atLineStart_ = false;
+    return all;
 }
 
 void MessageQueue::close() {
     std::lock_guard<std::mutex> lock(mutex_);
     closed_ = true;
-    
-    while (!waitingPromises_.empty()) {
-        auto promise = std::move(waitingPromises_.front());
-        waitingPromises_.pop();
-        promise.set_exception(std::make_exception_ptr(std::runtime_error("Queue closed")));
-    }
-    
+
     std::queue<Message> empty;
     messages_.swap(empty);
+    cv_.notify_all();
 }
 
 bool MessageQueue::isClosed() const {
@@ -117,16 +636,55 @@ bool MessageQueue::isClosed() const {
     return closed_;
 }
 
+// TrafficRecorder 实现
+TrafficRecorder::TrafficRecorder(const std::string& path) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) return;
+    std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+    TrafficRecordFileHeader header{};
+    std::memcpy(header.magic, kTrafficRecordMagic, sizeof(header.magic));
+    header.version = 1;
+    header.headerSize = sizeof(header);
+    header.startSystemNs = static_cast<uint64_t>(
+        duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
+    startNs_ = steadyNowNs();
+    std::fwrite(&header, sizeof(header), 1, file_);
+}
+
+TrafficRecorder::~TrafficRecorder() {
+    if (file_) std::fclose(file_);
+}
+
+void TrafficRecorder::record(TrafficRecordKind kind, const std::string& payload) {
+    if (!file_) return;
+    TrafficRecordHeader header{};
+    header.payloadSize = static_cast<uint32_t>(payload.size());
+    header.kind = static_cast<uint8_t>(kind);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 在锁内取时间, 保证文件中的时间戳单调
+    header.offsetNs = steadyNowNs() - startNs_;
+    std::fwrite(&header, sizeof(header), 1, file_);
+    std::fwrite(payload.data(), 1, payload.size(), file_);
+    count_.fetch_add(1, std::memory_order_relaxed);
+}
+
 // ConnectionRegistry 实现
-ConnectionRegistry::ConnectionRegistry(std::shared_ptr<LoggingService> logger) : logger_(logger) {}
+ConnectionRegistry::ConnectionRegistry(std::shared_ptr<LoggingService> logger,
+                                       std::shared_ptr<RequestTracer> tracer)
+    : logger_(logger), tracer_(tracer) {
+    registerBuiltinEventHandlers();
+}
 
 ConnectionRegistry::~ConnectionRegistry() {
+    std::lock_guard<std::mutex> lock(queuesMutex_);
     for (auto& [requestId, queue] : messageQueues_) {
         queue->close();
     }
 }
 
-void ConnectionRegistry::addConnection(websocketpp::connection_hdl::type hdl, const ClientInfo& clientInfo) {
+void ConnectionRegistry::addConnection(websocketpp::connection_hdl hdl, const ClientInfo& clientInfo) {
     {
         std::lock_guard<std::mutex> lock(connectionsMutex_);
         connections_.insert(hdl);
@@ -139,7 +697,7 @@ void ConnectionRegistry::addConnection(websocketpp::connection_hdl::type hdl, co
     }
 }
 
-void ConnectionRegistry::removeConnection(websocketpp::connection_hdl::type hdl) {
+void ConnectionRegistry::removeConnection(websocketpp::connection_hdl hdl) {
     {
         std::lock_guard<std::mutex> lock(connectionsMutex_);
         connections_.erase(hdl);
@@ -148,264 +706,2258 @@ void ConnectionRegistry::removeConnection(websocketpp::connection_hdl::type hdl)
     logger_->info("客户端连接断开");
     
     // 关闭所有相关的消息队列
-    for (auto& [requestId, queue] : messageQueues_) {
-        queue->close();
+    {
+        std::lock_guard<std::mutex> lock(queuesMutex_);
+        for (auto& [requestId, queue] : messageQueues_) {
+            queue->close();
+        }
+        messageQueues_.clear();
     }
-    messageQueues_.clear();
     
     for (auto& callback : connectionRemovedCallbacks_) {
         callback(hdl);
     }
 }
 
-void ConnectionRegistry::handleIncomingMessage(const std::string& messageData) {
-    try {
-        auto parsedMessage = json::parse(messageData);
-        
-        if (!parsedMessage.contains("request_id")) {
-            logger_->warn("收到无效消息：缺少request_id");
-            return;
-        }
-        
-        std::string requestId = parsedMessage["request_id"];
-        auto it = messageQueues_.find(requestId);
-        
-        if (it != messageQueues_.end()) {
-            Message msg;
-            msg.requestId = requestId;
-            if (parsedMessage.contains("event_type")) {
-                msg.eventType = parsedMessage["event_type"];
-            }
-            if (parsedMessage.contains("data")) {
-                msg.data = parsedMessage["data"];
-            }
-            if (parsedMessage.contains("status")) {
-                msg.status = parsedMessage["status"];
-            }
-            
-            routeMessage(msg, it->second);
-        } else {
-            logger_->warn("收到未知请求ID的消息: " + requestId);
-        }
-    } catch (const std::exception& e) {
-        logger_->error("解析WebSocket消息失败: " + std::string(e.what()));
+// 浏览器消息的顶层字段扫描: 只定位需要的字段, data 字段不经过 json DOM 复制
+// 消息来自不受信任的浏览器端, 扫描失败只返回 false, 不抛异常, 畸形消息的代价与正常消息同级
+static void skipJsonSpace(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+}
+
+// p 指向起始引号, 成功后指向结束引号之后; [begin, stop) 为转义前的内容
+static bool scanJsonString(const char*& p, const char* end, const char*& begin, const char*& stop, bool& escaped) {
+    begin = ++p;
+    escaped = false;
+    // 只有越过了上次找到的引号 (即它被转义) 才重新查找, 大量转义时扫描仍是线性的
+    const char* hit = nullptr;
+    while (p < end) {
+        if (!hit || hit < p) {
+            hit = static_cast<const char*>(std::memchr(p, '"', static_cast<size_t>(end - p)));
+            if (!hit) return false;
+        }
+        const char* backslash = static_cast<const char*>(std::memchr(p, '\\', static_cast<size_t>(hit - p)));
+        if (!backslash) {
+            stop = hit;
+            p = hit + 1;
+            return true;
+        }
+        escaped = true;
+        p = backslash + 2;
+    }
+    return false;
+}
+
+static bool skipJsonValue(const char*& p, const char* end) {
+    skipJsonSpace(p, end);
+    if (p >= end) return false;
+    if (*p == '"') {
+        const char *begin, *stop;
+        bool escaped;
+        return scanJsonString(p, end, begin, stop, escaped);
+    }
+    if (*p == '{' || *p == '[') {
+        size_t depth = 0;
+        while (p < end) {
+            if (*p == '"') {
+                const char *begin, *stop;
+                bool escaped;
+                if (!scanJsonString(p, end, begin, stop, escaped)) return false;
+                continue;
+            }
+            if (*p == '{' || *p == '[') ++depth;
+            if (*p == '}' || *p == ']') {
+                if (--depth == 0) {
+                    ++p;
+                    return true;
+                }
+            }
+            ++p;
+        }
+        return false;
+    }
+    const char* start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t') ++p;
+    return p != start;
+}
+
+static void appendUtf8(char*& out, uint32_t cp) {
+    if (cp < 0x80) {
+        *out++ = static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (cp >> 6));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (cp >> 12));
+        *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (cp >> 18));
+        *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+static bool readHex4(const char* p, const char* end, uint32_t& value) {
+    if (end - p < 4) return false;
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= static_cast<uint32_t>(c - '0');
+        else if (c >= 'a' && c <= 'f') value |= static_cast<uint32_t>(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') value |= static_cast<uint32_t>(c - 'A' + 10);
+        else return false;
+    }
+    return true;
+}
+
+// 原地反转义 [begin, end), 解码结果不会比原文长; length 为解码后的长度
+// scanJsonString 保证反斜杠之后总有一个字符仍在范围内
+static bool unescapeJsonInPlace(char* begin, const char* end, size_t& length) {
+    char* out = begin;
+    for (const char* p = begin; p < end;) {
+        if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+        char c = *++p;
+        ++p;
+        switch (c) {
+        case '"': *out++ = '"'; break;
+        case '\\': *out++ = '\\'; break;
+        case '/': *out++ = '/'; break;
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u': {
+            uint32_t cp;
+            if (!readHex4(p, end, cp)) return false;
+            p += 4;
+            uint32_t low;
+            if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                readHex4(p + 2, end, low) && low >= 0xDC00 && low < 0xE000) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+            appendUtf8(out, cp);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    length = static_cast<size_t>(out - begin);
+    return true;
+}
+
+static bool decodeJsonString(const char* begin, const char* stop, bool escaped, std::string& value) {
+    value.assign(begin, stop);
+    if (!escaped) return true;
+    size_t length;
+    if (!unescapeJsonInPlace(&value[0], value.data() + value.size(), length)) return false;
+    value.resize(length);
+    return true;
+}
+
+// 读取 headers 对象中的字符串值, 其余类型的值跳过; 不是对象时整体忽略
+static FrameError scanJsonHeaders(const char*& p, const char* end, std::map<std::string, std::string>& headers) {
+    if (*p != '{') return skipJsonValue(p, end) ? FrameError::None : FrameError::Malformed;
+    ++p;
+    skipJsonSpace(p, end);
+    if (p < end && *p == '}') {
+        ++p;
+        return FrameError::None;
+    }
+
+    std::string name, value;
+    while (true) {
+        skipJsonSpace(p, end);
+        if (p >= end || *p != '"') return FrameError::Malformed;
+        const char *begin, *stop;
+        bool escaped;
+        if (!scanJsonString(p, end, begin, stop, escaped)) return FrameError::Unterminated;
+        if (!decodeJsonString(begin, stop, escaped, name)) return FrameError::BadEscape;
+
+        skipJsonSpace(p, end);
+        if (p >= end || *p != ':') return FrameError::Malformed;
+        ++p;
+        skipJsonSpace(p, end);
+        if (p < end && *p == '"') {
+            if (!scanJsonString(p, end, begin, stop, escaped)) return FrameError::Unterminated;
+            if (!decodeJsonString(begin, stop, escaped, value)) return FrameError::BadEscape;
+            headers[name] = value;
+        } else if (!skipJsonValue(p, end)) {
+            return FrameError::Malformed;
+        }
+
+        skipJsonSpace(p, end);
+        if (p >= end) return FrameError::Unterminated;
+        if (*p == '}') {
+            ++p;
+            return FrameError::None;
+        }
+        if (*p++ != ',') return FrameError::Malformed;
+    }
+}
+
+const char* frameErrorName(FrameError error) {
+    switch (error) {
+    case FrameError::None: return "none";
+    case FrameError::NotObject: return "not_object";
+    case FrameError::Malformed: return "malformed";
+    case FrameError::Unterminated: return "unterminated";
+    case FrameError::BadEscape: return "bad_escape";
+    case FrameError::WrongType: return "wrong_type";
+    case FrameError::BadStatus: return "bad_status";
+    case FrameError::MissingRequestId: return "missing_request_id";
+    case FrameError::UnknownEvent: return "unknown_event";
+    case FrameError::UnknownRequest: return "unknown_request";
+    case FrameError::Count: break;
+    }
+    return "unknown";
+}
+
+// LogThrottle 实现
+bool LogThrottle::allow(uint64_t& suppressed) {
+    uint64_t now = steadyNowNs() / 1000000;
+    uint64_t next = nextMs_.load(std::memory_order_relaxed);
+    if (now < next || !nextMs_.compare_exchange_strong(next, now + intervalMs_, std::memory_order_relaxed)) {
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+void ConnectionRegistry::handleIncomingMessage(const std::string& messageData) {
+    copyStats_.copiedBytes.fetch_add(messageData.size(), std::memory_order_relaxed);
+    handleIncomingMessage(std::make_shared<std::string>(messageData));
+}
+
+void ConnectionRegistry::setTrafficRecorder(std::shared_ptr<TrafficRecorder> recorder) {
+    recorder_ = std::move(recorder);
+}
+
+FrameError ConnectionRegistry::parseFrame(std::string& frame, Message& msg, size_t& dataOffset, size_t& dataLength,
+                                          std::string& eventName) {
+    bool hasRequestId = false;
+    std::string decodedKey;
+
+    const char* p = frame.data();
+    const char* end = p + frame.size();
+    skipJsonSpace(p, end);
+    if (p >= end || *p != '{') return FrameError::NotObject;
+    ++p;
+    skipJsonSpace(p, end);
+    bool closed = p < end && *p == '}';
+    if (closed) ++p;
+
+    while (!closed) {
+        skipJsonSpace(p, end);
+        if (p >= end || *p != '"') return FrameError::Malformed;
+        const char *keyBegin, *keyEnd;
+        bool keyEscaped;
+        if (!scanJsonString(p, end, keyBegin, keyEnd, keyEscaped)) return FrameError::Unterminated;
+        std::string_view key(keyBegin, static_cast<size_t>(keyEnd - keyBegin));
+        if (keyEscaped) {
+            // 字段名里的转义很少见, 解码后再比较, 与标准 JSON 解析的结果保持一致
+            if (!decodeJsonString(keyBegin, keyEnd, true, decodedKey)) return FrameError::BadEscape;
+            key = decodedKey;
+        }
+
+        skipJsonSpace(p, end);
+        if (p >= end || *p != ':') return FrameError::Malformed;
+        ++p;
+        skipJsonSpace(p, end);
+        if (p >= end) return FrameError::Unterminated;
+        const char* valueBegin = p;
+
+        if (key == "request_id" || key == "event_type" || key == "data") {
+            if (*p != '"') return FrameError::WrongType;
+            const char *begin, *stop;
+            bool escaped;
+            if (!scanJsonString(p, end, begin, stop, escaped)) return FrameError::Unterminated;
+            if (key == "data") {
+                // 帧由本函数独占, 转义内容原地解码, 只移动第一个转义之后的字节
+                dataOffset = static_cast<size_t>(begin - frame.data());
+                dataLength = static_cast<size_t>(stop - begin);
+                if (escaped) {
+                    size_t untouched = static_cast<size_t>(
+                        static_cast<const char*>(std::memchr(begin, '\\', dataLength)) - begin);
+                    if (!unescapeJsonInPlace(&frame[dataOffset], stop, dataLength)) return FrameError::BadEscape;
+                    copyStats_.copiedBytes.fetch_add(dataLength - untouched, std::memory_order_relaxed);
+                }
+            } else if (key == "request_id") {
+                if (!decodeJsonString(begin, stop, escaped, msg.requestId)) return FrameError::BadEscape;
+                hasRequestId = true;
+            } else if (escaped) {
+                if (!decodeJsonString(begin, stop, escaped, eventName)) return FrameError::BadEscape;
+                msg.event = internEventType(eventName);
+            } else {
+                eventName.clear();
+                msg.event = internEventType(std::string_view(begin, static_cast<size_t>(stop - begin)));
+                if (msg.event == EventType::Unknown) eventName.assign(begin, stop);
+            }
+        } else if (key == "status") {
+            if (!skipJsonValue(p, end)) return FrameError::Malformed;
+            auto [parsedEnd, ec] = std::from_chars(valueBegin, p, msg.status);
+            if (ec != std::errc() || parsedEnd != p) return FrameError::BadStatus;
+        } else if (key == "headers") {
+            msg.headers.clear();    // 重复的字段以最后一个为准
+            FrameError error = scanJsonHeaders(p, end, msg.headers);
+            if (error != FrameError::None) return error;
+        } else if (!skipJsonValue(p, end)) {
+            return FrameError::Malformed;
+        }
+
+        skipJsonSpace(p, end);
+        if (p >= end) return FrameError::Unterminated;
+        if (*p != ',' && *p != '}') return FrameError::Malformed;
+        closed = *p++ == '}';
+    }
+
+    if (!hasRequestId) return FrameError::MissingRequestId;
+    if (msg.event == EventType::Unknown) return FrameError::UnknownEvent;
+    return FrameError::None;
+}
+
+void ConnectionRegistry::rejectFrame(FrameError error, const std::string& detail) {
+    parseStats_.rejected[static_cast<size_t>(error)].fetch_add(1, std::memory_order_relaxed);
+
+    // 出错的消息可能来自有问题的客户端, 日志限频, 避免日志本身成为负担
+    bool routing = error == FrameError::UnknownEvent || error == FrameError::UnknownRequest;
+    uint64_t suppressed = 0;
+    if (!(routing ? routingLog_ : parseErrorLog_).allow(suppressed)) return;
+    if (routing) {
+        DARK_LOG(logger_, LogLevel::Warn, "丢弃浏览器消息 ({}): {}, 此前省略 {} 条", frameErrorName(error), detail,
+                 suppressed);
+    } else {
+        DARK_LOG(logger_, LogLevel::Error, "解析WebSocket消息失败 ({}), 此前省略 {} 条", frameErrorName(error),
+                 suppressed);
+    }
+}
+
+void ConnectionRegistry::handleIncomingMessage(std::shared_ptr<std::string> frame) {
+    // 解析会原地修改帧, 录制必须在解析之前
+    if (recorder_) recorder_->record(TrafficRecordKind::BrowserEvent, *frame);
+
+    Message msg;
+    std::string eventName;      // 只在未知事件时用于日志
+    size_t dataOffset = 0;
+    size_t dataLength = 0;
+    FrameError error = parseFrame(*frame, msg, dataOffset, dataLength, eventName);
+    if (error != FrameError::None) {
+        rejectFrame(error, error == FrameError::UnknownEvent ? eventName : std::string());
+        return;
+    }
+
+    std::shared_ptr<MessageQueue> queue;
+    {
+        std::lock_guard<std::mutex> lock(queuesMutex_);
+        auto it = messageQueues_.find(msg.requestId);
+        if (it != messageQueues_.end()) {
+            queue = it->second;
+        }
+    }
+
+    if (!queue) {
+        rejectFrame(FrameError::UnknownRequest, msg.requestId);
+        return;
+    }
+    parseStats_.accepted.fetch_add(1, std::memory_order_relaxed);
+    msg.payload = PayloadBuffer(std::move(frame), dataOffset, dataLength);
+    try {
+        routeMessage(std::move(msg), queue);
+    } catch (const std::exception& e) {
+        // 插件注册的处理器可能抛异常
+        DARK_LOG(logger_, LogLevel::Error, "事件处理失败: {}", e.what());
+    }
+}
+
+void ConnectionRegistry::registerBuiltinEventHandlers() {
+    auto traced = [this](TraceStage stage) {
+        return [this, stage](Message&& message, const std::shared_ptr<MessageQueue>& queue) {
+            if (tracer_) tracer_->record(message.requestId, stage);
+            queue->enqueue(std::move(message));
+        };
+    };
+
+    eventNames_[static_cast<size_t>(EventType::ResponseHeaders)] = "response_headers";
+    eventNames_[static_cast<size_t>(EventType::Chunk)] = "chunk";
+    eventNames_[static_cast<size_t>(EventType::StreamClose)] = "stream_close";
+    eventNames_[static_cast<size_t>(EventType::Error)] = "error";
+    eventNames_[static_cast<size_t>(EventType::Progress)] = "progress";
+
+    eventHandlers_[static_cast<size_t>(EventType::ResponseHeaders)] = traced(TraceStage::ResponseHeaders);
+    eventHandlers_[static_cast<size_t>(EventType::Chunk)] = traced(TraceStage::Chunk);
+    eventHandlers_[static_cast<size_t>(EventType::StreamClose)] =
+        [this](Message&& message, const std::shared_ptr<MessageQueue>& queue) {
+            if (tracer_) tracer_->record(message.requestId, TraceStage::StreamEnd);
+            message.endOfStream = true;
+            queue->enqueue(std::move(message));
+        };
+    eventHandlers_[static_cast<size_t>(EventType::Error)] =
+        [](Message&& message, const std::shared_ptr<MessageQueue>& queue) {
+            queue->enqueue(std::move(message));
+        };
+    // 进度事件只用于观察, 不进入响应
+    eventHandlers_[static_cast<size_t>(EventType::Progress)] =
+        [this](Message&& message, const std::shared_ptr<MessageQueue>&) {
+            DARK_LOG(logger_, LogLevel::Debug, "请求进度: {} {}", message.requestId, message.payload.str());
+        };
+}
+
+EventType ConnectionRegistry::registerEventHandler(const std::string& name, EventHandler handler) {
+    EventType existing = internEventType(name);
+    if (existing != EventType::Unknown) {
+        eventHandlers_[static_cast<size_t>(existing)] = std::move(handler);
+        return existing;
+    }
+    if (eventTypeCount_ >= kMaxEventTypes) {
+        throw std::runtime_error("事件类型数量超过上限: " + name);
+    }
+    eventNames_[eventTypeCount_] = name;
+    eventHandlers_[eventTypeCount_] = std::move(handler);
+    return static_cast<EventType>(eventTypeCount_++);
+}
+
+EventType ConnectionRegistry::internEventType(std::string_view name) const {
+    for (size_t i = 1; i < eventTypeCount_; ++i) {
+        if (eventNames_[i] == name) return static_cast<EventType>(i);
+    }
+    return EventType::Unknown;
+}
+
+void ConnectionRegistry::routeMessage(Message&& message, std::shared_ptr<MessageQueue> queue) {
+    const EventHandler& handler = eventHandlers_[static_cast<size_t>(message.event)];
+    if (handler) {
+        handler(std::move(message), queue);
+    }
+}
+
+bool ConnectionRegistry::hasActiveConnections() const {
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    return !connections_.empty();
+}
+
+websocketpp::connection_hdl ConnectionRegistry::getFirstConnection() const {
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    if (!connections_.empty()) {
+        return *connections_.begin();
+    }
+    return websocketpp::connection_hdl();
+}
+
+std::shared_ptr<MessageQueue> ConnectionRegistry::createMessageQueue(const std::string& requestId,
+                                                                     std::chrono::milliseconds timeout,
+                                                                     size_t maxQueues) {
+    auto queue = std::make_shared<MessageQueue>(timeout);
+    std::lock_guard<std::mutex> lock(queuesMutex_);
+    if (maxQueues != 0 && messageQueues_.size() >= maxQueues) {
+        return nullptr;
+    }
+    messageQueues_[requestId] = queue;
+    return queue;
+}
+
+void ConnectionRegistry::removeMessageQueue(const std::string& requestId) {
+    std::lock_guard<std::mutex> lock(queuesMutex_);
+    auto it = messageQueues_.find(requestId);
+    if (it != messageQueues_.end()) {
+        it->second->close();
+        messageQueues_.erase(it);
+    }
+}
+
+void ConnectionRegistry::onConnectionAdded(ConnectionCallback callback) {
+    connectionAddedCallbacks_.push_back(callback);
+}
+
+void ConnectionRegistry::onConnectionRemoved(ConnectionCallback callback) {
+    connectionRemovedCallbacks_.push_back(callback);
+}
+
+// RequestScheduler 实现
+RequestScheduler::Lane::Lane(websocketpp::connection_hdl hdl, size_t classCount)
+    : hdl(std::move(hdl)), deficits(classCount, 0) {
+    for (size_t i = 0; i < classCount; ++i) {
+        queues.push_back(std::make_unique<MpscQueue<std::shared_ptr<Ticket>>>());
+    }
+}
+
+RequestScheduler::RequestScheduler(std::shared_ptr<LoggingService> logger, std::vector<PriorityClassConfig> classes,
+                                   uint32_t maxInflightPerConnection)
+    : logger_(logger), classes_(std::move(classes)), maxInflight_(maxInflightPerConnection),
+      lanes_(std::make_shared<const LaneList>()) {
+    if (classes_.empty()) {
+        classes_.push_back(PriorityClassConfig{"default", 1, "", "", ""});
+    }
+
+    defaultClass_ = classes_.size() - 1;
+    for (size_t i = classes_.size(); i-- > 0;) {
+        if (classes_[i].weight == 0) classes_[i].weight = 1;
+        if (classes_[i].pathPrefix.empty() && classes_[i].header.empty()) defaultClass_ = i;
+    }
+}
+
+size_t RequestScheduler::classify(const httplib::Request& req) const {
+    for (size_t i = 0; i < classes_.size(); ++i) {
+        const auto& cls = classes_[i];
+        if (!cls.pathPrefix.empty() && req.path.compare(0, cls.pathPrefix.size(), cls.pathPrefix) == 0) {
+            return i;
+        }
+        if (!cls.header.empty() && req.has_header(cls.header) &&
+            (cls.headerValue.empty() || req.get_header_value(cls.header) == cls.headerValue)) {
+            return i;
+        }
+    }
+    return defaultClass_;
+}
+
+void RequestScheduler::addConnection(websocketpp::connection_hdl hdl) {
+    std::lock_guard<std::mutex> lock(lanesWriteMutex_);
+    auto next = std::make_shared<LaneList>(*std::atomic_load(&lanes_));
+    next->push_back(std::make_shared<Lane>(hdl, classes_.size()));
+    std::atomic_store(&lanes_, std::shared_ptr<const LaneList>(std::move(next)));
+}
+
+void RequestScheduler::removeConnection(websocketpp::connection_hdl hdl) {
+    std::lock_guard<std::mutex> lock(lanesWriteMutex_);
+    auto next = std::make_shared<LaneList>(*std::atomic_load(&lanes_));
+    std::owner_less<websocketpp::connection_hdl> less;
+    next->erase(std::remove_if(next->begin(), next->end(),
+                               [&](const std::shared_ptr<Lane>& lane) {
+                                   return !less(lane->hdl, hdl) && !less(hdl, lane->hdl);
+                               }),
+                next->end());
+    std::atomic_store(&lanes_, std::shared_ptr<const LaneList>(std::move(next)));
+}
+
+std::shared_ptr<RequestScheduler::Ticket> RequestScheduler::submit(size_t priority, Dispatch dispatch) {
+    auto lanes = std::atomic_load(&lanes_);
+    std::shared_ptr<Lane> lane;
+    uint32_t bestLoad = UINT32_MAX;
+    for (const auto& candidate : *lanes) {
+        uint32_t load = candidate->inflight.load(std::memory_order_relaxed) +
+                        candidate->queued.load(std::memory_order_relaxed);
+        if (load < bestLoad) {
+            bestLoad = load;
+            lane = candidate;
+        }
+    }
+    if (!lane) return nullptr;
+
+    auto ticket = std::make_shared<Ticket>();
+    ticket->lane = lane;
+
+    if (maxInflight_ == 0) {
+        ticket->state.store(Ticket::Dispatched);
+        lane->inflight.fetch_add(1);
+        dispatch(lane->hdl);
+        return ticket;
+    }
+
+    ticket->dispatch = std::move(dispatch);
+    lane->queued.fetch_add(1);
+    lane->queues[std::min(priority, classes_.size() - 1)]->push(ticket);
+    drain(*lane);
+    return ticket;
+}
+
+void RequestScheduler::complete(const std::shared_ptr<Ticket>& ticket) {
+    if (!ticket) return;
+
+    // 仍在排队: 标记取消, 出队时跳过
+    int expected = Ticket::Queued;
+    if (ticket->state.compare_exchange_strong(expected, Ticket::Cancelled)) return;
+
+    if (expected == Ticket::Dispatched && ticket->state.compare_exchange_strong(expected, Ticket::Finished)) {
+        auto lane = ticket->lane.lock();
+        if (!lane) return;
+        lane->inflight.fetch_sub(1);
+        if (maxInflight_ != 0) drain(*lane);
+    }
+}
+
+// 同一时刻只有一个线程出队; 释放出队权后复查, 避免与并发的入队或完成错过彼此
+void RequestScheduler::drain(Lane& lane) {
+    while (true) {
+        if (lane.draining.exchange(true)) return;
+        while (drainOnce(lane)) {}
+        lane.draining.store(false);
+
+        if (lane.queued.load() == 0 || lane.inflight.load() >= maxInflight_) return;
+    }
+}
+
+// 按赤字轮询出队一个请求: 每个类别一轮可以连续发出 weight 个请求
+bool RequestScheduler::drainOnce(Lane& lane) {
+    if (lane.inflight.load() >= maxInflight_) return false;
+
+    size_t count = lane.queues.size();
+    for (size_t i = 0; i < count; ++i) {
+        size_t c = (lane.cursor + i) % count;
+        auto& queue = *lane.queues[c];
+        if (queue.empty()) {
+            lane.deficits[c] = 0;
+            continue;
+        }
+
+        std::shared_ptr<Ticket> ticket;
+        if (!queue.pop(ticket)) continue;     // 生产者尚未链接完成
+        lane.queued.fetch_sub(1);
+        lane.cursor = c;
+        if (lane.deficits[c] == 0) lane.deficits[c] = classes_[c].weight;
+
+        lane.inflight.fetch_add(1);
+        int expected = Ticket::Queued;
+        if (!ticket->state.compare_exchange_strong(expected, Ticket::Dispatched)) {
+            lane.inflight.fetch_sub(1);       // 排队期间已取消, 不消耗赤字
+            return true;
+        }
+
+        if (--lane.deficits[c] == 0) lane.cursor = (c + 1) % count;
+        Dispatch dispatch = std::move(ticket->dispatch);
+        dispatch(lane.hdl);
+        return true;
+    }
+    return false;
+}
+
+// RequestHandler 实现
+static constexpr const char* kClientClosedError = "Client closed";
+// 等待浏览器数据时检查客户端连接的间隔
+static constexpr auto kDisconnectCheckInterval = milliseconds(250);
+
+RequestHandler::RequestHandler(std::shared_ptr<ConnectionRegistry> connectionRegistry,
+                               std::shared_ptr<LoggingService> logger,
+                               std::shared_ptr<RequestTracer> tracer,
+                               std::shared_ptr<RateLimiter> rateLimiter,
+                               std::shared_ptr<const ConfigStore> configStore,
+                               std::shared_ptr<RequestScheduler> scheduler)
+    : connectionRegistry_(connectionRegistry), logger_(logger), tracer_(tracer), rateLimiter_(rateLimiter),
+      configStore_(configStore), scheduler_(scheduler) {}
+
+void RequestHandler::setMessageSender(MessageSender sender) {
+    messageSender_ = std::move(sender);
+}
+
+void RequestHandler::setTrafficRecorder(std::shared_ptr<TrafficRecorder> recorder) {
+    recorder_ = std::move(recorder);
+}
+
+void RequestHandler::processRequest(const httplib::Request& req, httplib::Response& res) {
+    uint64_t acceptNs = steadyNowNs();
+    DARK_LOG(logger_, LogLevel::Info, "处理请求: {} {}", req.method, req.path);
+
+    uint64_t retryAfterMs = 0;
+    if (rateLimiter_ && !rateLimiter_->allowRequest(req, &retryAfterMs)) {
+        DARK_LOG(logger_, LogLevel::Warn, "请求被限流: {}", req.remote_addr);
+        sendErrorResponse(res, 429, "请求过于频繁");
+        res.set_header("Retry-After", std::to_string((retryAfterMs + 999) / 1000));
+        return;
+    }
+
+    if (!connectionRegistry_->hasActiveConnections()) {
+        sendErrorResponse(res, 503, "没有可用的浏览器连接");
+        return;
+    }
+
+    std::string requestId = generateRequestId();
+    if (tracer_) tracer_->record(requestId, TraceStage::Accept, acceptNs);
+
+    RequestDeadline deadline = requestDeadline(req);
+    Message proxyRequest = buildProxyRequest(req, requestId, deadline);
+    if (tracer_) tracer_->record(requestId, TraceStage::BuildProxyRequest);
+
+    size_t maxQueues = configStore_ ? configStore_->current().maxConcurrentRequests : 0;
+    auto messageQueue = connectionRegistry_->createMessageQueue(requestId, requestTimeout(), maxQueues);
+    if (!messageQueue) {
+        sendErrorResponse(res, 503, "代理繁忙, 请稍后重试");
+        return;
+    }
+
+    std::shared_ptr<RequestScheduler::Ticket> ticket;
+    bool streaming = false;
+    try {
+        ticket = dispatchRequest(req, std::move(proxyRequest), messageQueue);
+        streaming = handleResponse(req, messageQueue, requestId, deadline, res, ticket);
+    } catch (const std::exception& error) {
+        std::string reason = error.what();
+        if (reason.find("timeout") != std::string::npos) {
+            cancelRequest(requestId, *messageQueue, "deadline_exceeded");
+        } else if (reason == kClientClosedError) {
+            cancelRequest(requestId, *messageQueue, "client_closed");
+        }
+        handleRequestError(error, res);
+    }
+
+    if (!streaming) {
+        finishRequest(requestId, ticket);
+    }
+}
+
+void RequestHandler::finishRequest(const std::string& requestId,
+                                   const std::shared_ptr<RequestScheduler::Ticket>& ticket) {
+    connectionRegistry_->removeMessageQueue(requestId);
+    if (scheduler_) scheduler_->complete(ticket);
+    if (tracer_) tracer_->record(requestId, TraceStage::ResponseComplete);
+}
+
+std::chrono::milliseconds RequestHandler::requestTimeout() const {
+    if (!configStore_) return std::chrono::milliseconds(600000);
+    return std::chrono::milliseconds(configStore_->current().requestTimeoutMs);
+}
+
+RequestDeadline RequestHandler::requestDeadline(const httplib::Request& req) const {
+    const ServerConfig defaults;
+    const ServerConfig& config = configStore_ ? configStore_->current() : defaults;
+
+    RequestDeadline deadline;
+    int64_t timeoutMs = config.requestTimeoutMs;
+    for (const auto& route : config.routeTimeouts) {
+        if (req.path.compare(0, route.pathPrefix.size(), route.pathPrefix) == 0) {
+            timeoutMs = route.timeoutMs;
+            deadline.explicitLimit = true;
+            break;
+        }
+    }
+
+    // 请求头只能缩短超时; 无法解析的值忽略
+    if (!config.requestTimeoutHeader.empty() && req.has_header(config.requestTimeoutHeader)) {
+        const std::string value = req.get_header_value(config.requestTimeoutHeader);
+        int64_t requested = 0;
+        auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), requested);
+        if (ec == std::errc() && end == value.data() + value.size() && requested > 0) {
+            timeoutMs = std::min(timeoutMs, requested);
+            deadline.explicitLimit = true;
+        } else {
+            DARK_LOG(logger_, LogLevel::Debug, "忽略无效的超时请求头: {}", value);
+        }
+    }
+
+    deadline.at = steady_clock::now() + milliseconds(timeoutMs);
+    deadline.unixMs = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count() + timeoutMs;
+    return deadline;
+}
+
+std::string RequestHandler::generateRequestId() {
+    auto now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<> dis(0, 35);
+
+    std::string randomStr;
+    for (int i = 0; i < 9; ++i) {
+        char c = (dis(gen) < 10) ? ('0' + dis(gen)) : ('a' + dis(gen) - 10);
+        randomStr += c;
+    }
+
+    return std::to_string(now) + "_" + randomStr;
+}
+
+Message RequestHandler::buildProxyRequest(const httplib::Request& req, const std::string& requestId,
+                                          const RequestDeadline& deadline) {
+    Message proxyRequest;
+    proxyRequest.requestId = requestId;
+    proxyRequest.type = "proxy_request";
+
+    // 构建请求数据 (简化版本)
+    json requestData;
+    requestData["path"] = req.path;
+    requestData["method"] = req.method;
+    requestData["request_id"] = requestId;
+    requestData["body"] = req.body;
+    // 浏览器据此放弃已无人等待的工作
+    requestData["deadline_ms"] = deadline.unixMs;
+
+    // 添加headers
+    json headers;
+    for (const auto& [name, value] : req.headers) {
+        headers[name] = value;
+    }
+    requestData["headers"] = headers;
+
+    proxyRequest.data = requestData.dump();
+    return proxyRequest;
+}
+
+std::shared_ptr<RequestScheduler::Ticket> RequestHandler::dispatchRequest(const httplib::Request& req,
+                                                                          Message proxyRequest,
+                                                                          std::shared_ptr<MessageQueue> messageQueue) {
+    if (!scheduler_) {
+        auto connection = connectionRegistry_->getFirstConnection();
+        messageQueue->setOwner(connection);
+        forwardRequest(proxyRequest, connection);
+        return nullptr;
+    }
+
+    // 排队的请求可能由其他线程发出, 发送失败时通过消息队列把错误交回等待中的请求
+    size_t priority = scheduler_->classify(req);
+    auto ticket = scheduler_->submit(priority, [this, proxyRequest = std::move(proxyRequest),
+                                                messageQueue](websocketpp::connection_hdl connection) {
+        try {
+            messageQueue->setOwner(connection);
+            forwardRequest(proxyRequest, connection);
+        } catch (const std::exception& e) {
+            Message error;
+            error.event = EventType::Error;
+            error.status = 502;
+            error.payload = PayloadBuffer(std::string(e.what()));
+            messageQueue->enqueue(std::move(error));
+        }
+    });
+    if (!ticket) {
+        throw std::runtime_error("没有可用的浏览器连接");
+    }
+    return ticket;
+}
+
+void RequestHandler::forwardRequest(const Message& proxyRequest, websocketpp::connection_hdl connection) {
+    if (!messageSender_ || connection.expired()) {
+        throw std::runtime_error("没有可用的浏览器连接");
+    }
+
+    if (recorder_) recorder_->record(TrafficRecordKind::ProxyRequest, proxyRequest.data);
+    messageSender_(connection, proxyRequest.data);
+    if (tracer_) tracer_->record(proxyRequest.requestId, TraceStage::WebSocketSend);
+}
+
+static bool equalsIgnoreCase(const std::string& a, const char* b) {
+    size_t n = std::strlen(b);
+    if (a.size() != n) return false;
+    for (size_t i = 0; i < n; ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string findHeader(const std::map<std::string, std::string>& headers, const char* name) {
+    for (const auto& [key, value] : headers) {
+        if (equalsIgnoreCase(key, name)) return value;
+    }
+    return "";
+}
+
+bool RequestHandler::handleResponse(const httplib::Request& req, std::shared_ptr<MessageQueue> messageQueue,
+                                    const std::string& requestId, const RequestDeadline& deadline,
+                                    httplib::Response& res, std::shared_ptr<RequestScheduler::Ticket> ticket) {
+    try {
+        // 等待响应头, 调度器中排队的时间也计入截止时间
+        Message headerMessage;
+        if (!waitForMessage(req, *messageQueue, headerMessage, deadline.at)) {
+            throw std::runtime_error("Queue timeout");
+        }
+
+        if (headerMessage.event == EventType::Error) {
+            sendErrorResponse(res, headerMessage.status, headerMessage.payload.str());
+            return false;
+        }
+
+        // 设置响应头
+        setResponseHeaders(res, headerMessage);
+
+        // SSE 响应逐事件转发, 其余响应整体缓冲
+        std::string contentType = findHeader(headerMessage.headers, "Content-Type");
+        bool sseStreaming = configStore_ ? configStore_->current().sseStreaming : true;
+        if (sseStreaming && contentType.find("text/event-stream") != std::string::npos) {
+            streamServerSentEvents(messageQueue, requestId, deadline, contentType, res, std::move(ticket));
+            return true;
+        }
+
+        // 处理流式数据
+        streamResponseData(req, messageQueue, requestId, deadline, res);
+        return false;
+    } catch (const std::exception& e) {
+        throw;
+    }
+}
+
+bool RequestHandler::waitForMessage(const httplib::Request& req, MessageQueue& messageQueue, Message& message,
+                                    steady_clock::time_point deadline) {
+    while (true) {
+        auto now = steady_clock::now();
+        if (now >= deadline) return false;
+        if (messageQueue.popUntil(message, std::min(deadline, now + kDisconnectCheckInterval))) return true;
+        if (req.is_connection_closed && req.is_connection_closed()) {
+            throw std::runtime_error(kClientClosedError);
+        }
+    }
+}
+
+void RequestHandler::setResponseHeaders(httplib::Response& res, const Message& headerMessage) {
+    res.status = headerMessage.status;
+
+    for (const auto& [name, value] : headerMessage.headers) {
+        // 分帧相关的头由本服务重新生成
+        if (equalsIgnoreCase(name, "Content-Length") || equalsIgnoreCase(name, "Transfer-Encoding") ||
+            equalsIgnoreCase(name, "Connection") || equalsIgnoreCase(name, "Content-Type")) {
+            continue;
+        }
+        res.set_header(name, value);
+    }
+
+    std::string contentType = findHeader(headerMessage.headers, "Content-Type");
+    if (!contentType.empty()) {
+        res.set_header("Content-Type", contentType);
+    }
+}
+
+void RequestHandler::streamServerSentEvents(std::shared_ptr<MessageQueue> messageQueue, const std::string& requestId,
+                                            const RequestDeadline& deadline, const std::string& contentType,
+                                            httplib::Response& res, std::shared_ptr<RequestScheduler::Ticket> ticket) {
+    const ServerConfig defaults;
+    const ServerConfig& config = configStore_ ? configStore_->current() : defaults;
+    auto window = std::chrono::microseconds(config.sseCoalesceWindowUs);
+    size_t maxBuffered = config.sseMaxBufferedBytes;
+    auto keepaliveInterval = milliseconds(config.requestTimeoutMs);
+    // 没有显式截止时间的事件流可以无限期持续
+    auto streamDeadline = deadline.explicitLimit ? deadline.at : steady_clock::time_point::max();
+
+    // Content-Type 由 set_chunked_content_provider 重新设置
+    res.headers.erase("Content-Type");
+
+    auto coalescer = std::make_shared<SseCoalescer>();
+    PayloadCopyStats& stats = connectionRegistry_->copyStats();
+    auto nextKeepalive = std::make_shared<steady_clock::time_point>(steady_clock::now() + keepaliveInterval);
+    auto provider = [this, messageQueue, requestId, coalescer, window, maxBuffered, keepaliveInterval,
+                     streamDeadline, nextKeepalive, &stats](size_t, httplib::DataSink& sink) {
+        auto flush = [&sink, &stats, &nextKeepalive, keepaliveInterval](const std::string& data) {
+            stats.proxiedBytes.fetch_add(data.size(), std::memory_order_relaxed);
+            *nextKeepalive = steady_clock::now() + keepaliveInterval;
+            return data.empty() || sink.write(data.data(), data.size());
+        };
+
+        try {
+            // 分段等待, 客户端断开时不必等到下一次写出才发现
+            Message message;
+            auto now = steady_clock::now();
+            auto waitUntil = std::min({now + kDisconnectCheckInterval, *nextKeepalive, streamDeadline});
+            if (!messageQueue->popUntil(message, waitUntil)) {
+                now = steady_clock::now();
+                if (now >= streamDeadline) {
+                    DARK_LOG(logger_, LogLevel::Warn, "SSE 超过截止时间: {}", requestId);
+                    cancelRequest(requestId, *messageQueue, "deadline_exceeded");
+                    return false;
+                }
+                if (sink.is_writable && !sink.is_writable()) {
+                    return false;   // 资源释放回调负责通知浏览器
+                }
+                // 长时间无数据时发送注释行保活, 与 JS 版本一致
+                if (now >= *nextKeepalive) return flush(": keepalive\n\n");
+                return true;
+            }
+
+            // 第一块到达后在时间窗口内继续收集, 合并成一次写出
+            auto deadline = steady_clock::now() + window;
+            while (true) {
+                if (message.endOfStream) {
+                    if (!flush(coalescer->takeAll())) return false;
+                    sink.done();
+                    return true;
+                }
+                // 合并小事件需要一次复制, 换来更少的写出次数
+                coalescer->append(message.payload.data(), message.payload.size());
+                stats.copiedBytes.fetch_add(message.payload.size(), std::memory_order_relaxed);
+                if (coalescer->bufferedBytes() >= maxBuffered) break;
+                if (!messageQueue->popUntil(message, deadline)) break;
+            }
+
+            if (coalescer->hasCompleteEvents()) {
+                return flush(coalescer->takeCompleteEvents());
+            }
+            // 单个事件超过缓冲上限时不再等待边界
+            if (coalescer->bufferedBytes() >= maxBuffered) {
+                return flush(coalescer->takeAll());
+            }
+            return true;
+        } catch (const std::exception& e) {
+            DARK_LOG(logger_, LogLevel::Error, "SSE 转发中断: {} {}", requestId, e.what());
+            return false;
+        }
+    };
+
+    res.set_chunked_content_provider(contentType, provider, [this, messageQueue, requestId, ticket](bool success) {
+        // 未正常结束 (多为客户端断开) 时浏览器端的生成已无意义
+        if (!success) cancelRequest(requestId, *messageQueue, "client_closed");
+        finishRequest(requestId, ticket);
+    });
+}
+
+void RequestHandler::streamResponseData(const httplib::Request& req, std::shared_ptr<MessageQueue> messageQueue,
+                                        const std::string& requestId, const RequestDeadline& deadline,
+                                        httplib::Response& res) {
+    // 只保存对各帧的引用, 写出时逐片交给 socket, 不拼接成整块 body
+    auto slices = std::make_shared<std::vector<PayloadBuffer>>();
+    size_t totalBytes = 0;
+
+    while (true) {
+        Message dataMessage;
+        if (!waitForMessage(req, *messageQueue, dataMessage, deadline.at)) {
+            // 超时后返回已收到的部分, 并让浏览器停止继续生成
+            DARK_LOG(logger_, LogLevel::Warn, "响应体超过截止时间: {}", requestId);
+            cancelRequest(requestId, *messageQueue, "deadline_exceeded");
+            break;
+        }
+
+        if (dataMessage.endOfStream) {
+            break;
+        }
+
+        if (!dataMessage.payload.empty()) {
+            totalBytes += dataMessage.payload.size();
+            slices->push_back(std::move(dataMessage.payload));
+        }
+    }
+
+    connectionRegistry_->copyStats().proxiedBytes.fetch_add(totalBytes, std::memory_order_relaxed);
+
+    // Content-Type 由 set_content_provider 重新设置
+    std::string contentType = res.get_header_value("Content-Type");
+    res.headers.erase("Content-Type");
+    if (contentType.empty()) contentType = "text/plain";
+
+    res.set_content_provider(totalBytes, contentType,
+                             [slices](size_t offset, size_t, httplib::DataSink& sink) {
+        // offset 落在哪个分片上, 就从该分片的对应位置继续写
+        size_t position = 0;
+        for (const auto& slice : *slices) {
+            if (offset < position + slice.size()) {
+                size_t skip = offset - position;
+                if (!sink.write(slice.data() + skip, slice.size() - skip)) return false;
+                offset = position + slice.size();
+            }
+            position += slice.size();
+        }
+        return true;
+    });
+}
+
+void RequestHandler::cancelRequest(const std::string& requestId, MessageQueue& messageQueue, const char* reason) {
+    auto owner = messageQueue.takeOwner();
+    if (owner.expired() || !messageSender_) return;
+
+    json cancel;
+    cancel["event_type"] = "cancel_request";
+    cancel["request_id"] = requestId;
+    cancel["reason"] = reason;
+    try {
+        messageSender_(owner, cancel.dump());
+        DARK_LOG(logger_, LogLevel::Info, "已通知浏览器取消请求: {} ({})", requestId, reason);
+    } catch (const std::exception& e) {
+        DARK_LOG(logger_, LogLevel::Warn, "发送取消事件失败: {} {}", requestId, e.what());
+    }
+}
+
+void RequestHandler::handleRequestError(const std::exception& error, httplib::Response& res) {
+    std::string errorMsg = error.what();
+    if (errorMsg.find("timeout") != std::string::npos) {
+        sendErrorResponse(res, 504, "请求超时");
+    } else if (errorMsg == kClientClosedError) {
+        // 响应已无人接收, 状态码只用于访问日志 (与 nginx 的 499 一致)
+        DARK_LOG(logger_, LogLevel::Info, "客户端在响应前断开");
+        sendErrorResponse(res, 499, "客户端已断开");
+    } else {
+        DARK_LOG(logger_, LogLevel::Error, "请求处理错误: {}", errorMsg);
+        sendErrorResponse(res, 500, "代理错误: " + errorMsg);
+    }
+}
+
+void RequestHandler::sendErrorResponse(httplib::Response& res, int status, const std::string& message) {
+    res.status = status;
+    res.body = message;
+    res.set_header("Content-Type", "text/plain; charset=utf-8");
+}
+
+// ConfigStore 实现
+ConfigStore::ConfigStore(const ServerConfig& initial) {
+    snapshots_.push_back(std::make_unique<const ServerConfig>(initial));
+    current_.store(snapshots_.back().get(), std::memory_order_release);
+}
+
+void ConfigStore::publish(const ServerConfig& next) {
+    std::lock_guard<std::mutex> lock(writerMutex_);
+    snapshots_.push_back(std::make_unique<const ServerConfig>(next));
+    current_.store(snapshots_.back().get(), std::memory_order_release);
+}
+
+// 配置文件加载
+static bool parseLogLevel(const std::string& name, LogLevel& level) {
+    if (name == "debug") level = LogLevel::Debug;
+    else if (name == "info") level = LogLevel::Info;
+    else if (name == "warn") level = LogLevel::Warn;
+    else if (name == "error") level = LogLevel::Error;
+    else return false;
+    return true;
+}
+
+template <typename T>
+static void readConfigField(const json& j, const char* key, T& out) {
+    if (j.contains(key)) {
+        out = j.at(key).get<T>();
+    }
+}
+
+bool loadServerConfig(const std::string& path, ServerConfig& config, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "无法打开配置文件: " + path;
+        return false;
+    }
+
+    json j = json::parse(in, nullptr, false, true);
+    if (j.is_discarded() || !j.is_object()) {
+        error = "配置文件不是有效的 JSON 对象: " + path;
+        return false;
+    }
+
+    try {
+        readConfigField(j, "httpPort", config.httpPort);
+        readConfigField(j, "wsPort", config.wsPort);
+        readConfigField(j, "host", config.host);
+        readConfigField(j, "httpThreads", config.httpThreads);
+        readConfigField(j, "requestTimeoutMs", config.requestTimeoutMs);
+        readConfigField(j, "requestTimeoutHeader", config.requestTimeoutHeader);
+        readConfigField(j, "maxConcurrentRequests", config.maxConcurrentRequests);
+        readConfigField(j, "sseStreaming", config.sseStreaming);
+        readConfigField(j, "sseCoalesceWindowUs", config.sseCoalesceWindowUs);
+        readConfigField(j, "sseMaxBufferedBytes", config.sseMaxBufferedBytes);
+        readConfigField(j, "epollFrontend", config.epollFrontend);
+        readConfigField(j, "keepAliveTimeoutSec", config.keepAliveTimeoutSec);
+        readConfigField(j, "maxRequestBytes", config.maxRequestBytes);
+        readConfigField(j, "slabSize", config.slabSize);
+        readConfigField(j, "binaryLogPath", config.binaryLogPath);
+        readConfigField(j, "binaryLogCapacity", config.binaryLogCapacity);
+        readConfigField(j, "traceSampleEvery", config.traceSampleEvery);
+        readConfigField(j, "traceRingCapacity", config.traceRingCapacity);
+        readConfigField(j, "traceEndpoint", config.traceEndpoint);
+        readConfigField(j, "rateLimitPerSecond", config.rateLimitPerSecond);
+        readConfigField(j, "rateLimitBurst", config.rateLimitBurst);
+        readConfigField(j, "rateLimitKeyHeader", config.rateLimitKeyHeader);
+        readConfigField(j, "recordPath", config.recordPath);
+        readConfigField(j, "maxInflightPerConnection", config.maxInflightPerConnection);
+        readConfigField(j, "tlsCertFile", config.tlsCertFile);
+        readConfigField(j, "tlsKeyFile", config.tlsKeyFile);
+        readConfigField(j, "tlsSessionTickets", config.tlsSessionTickets);
+        readConfigField(j, "tlsKtls", config.tlsKtls);
+        readConfigField(j, "workerProcesses", config.workerProcesses);
+        readConfigField(j, "maxHandoffBytes", config.maxHandoffBytes);
+
+        if (j.contains("priorityClasses")) {
+            config.priorityClasses.clear();
+            for (const auto& item : j.at("priorityClasses")) {
+                PriorityClassConfig cls;
+                readConfigField(item, "name", cls.name);
+                readConfigField(item, "weight", cls.weight);
+                readConfigField(item, "pathPrefix", cls.pathPrefix);
+                readConfigField(item, "header", cls.header);
+                readConfigField(item, "headerValue", cls.headerValue);
+                if (cls.weight == 0) {
+                    error = "优先级类别的 weight 必须为正数: " + cls.name;
+                    return false;
+                }
+                config.priorityClasses.push_back(std::move(cls));
+            }
+        }
+
+        if (j.contains("routeTimeouts")) {
+            config.routeTimeouts.clear();
+            for (const auto& item : j.at("routeTimeouts")) {
+                RouteTimeoutConfig route;
+                readConfigField(item, "pathPrefix", route.pathPrefix);
+                readConfigField(item, "timeoutMs", route.timeoutMs);
+                if (route.timeoutMs <= 0) {
+                    error = "路由超时的 timeoutMs 必须为正数: " + route.pathPrefix;
+                    return false;
+                }
+                config.routeTimeouts.push_back(std::move(route));
+            }
+        }
+
+        if (j.contains("logLevel") && !parseLogLevel(j.at("logLevel").get<std::string>(), config.logLevel)) {
+            error = "未知的日志级别: " + j.at("logLevel").get<std::string>();
+            return false;
+        }
+    } catch (const json::exception& e) {
+        error = "配置字段类型错误: " + std::string(e.what());
+        return false;
+    }
+
+    if (config.httpThreads <= 0 || config.requestTimeoutMs <= 0) {
+        error = "httpThreads 和 requestTimeoutMs 必须为正数";
+        return false;
+    }
+    if (config.keepAliveTimeoutSec <= 0 || config.slabSize < 1024 || config.maxRequestBytes > UINT32_MAX) {
+        error = "keepAliveTimeoutSec 必须为正数, slabSize 不小于 1024, maxRequestBytes 不超过 4GB";
+        return false;
+    }
+    return true;
+}
+
+#ifdef __linux__
+// SlabPool 实现
+SlabPool::SlabPool(size_t slabSize, size_t maxCached) : slabSize_(slabSize), maxCached_(maxCached) {}
+
+SlabPool::~SlabPool() {
+    for (char* slab : free_) {
+        delete[] slab;
+    }
+}
+
+char* SlabPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            char* slab = free_.back();
+            free_.pop_back();
+            return slab;
+        }
+    }
+    return new char[slabSize_];
+}
+
+void SlabPool::release(char* slab) {
+    if (!slab) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.size() < maxCached_) {
+            free_.push_back(slab);
+            return;
+        }
+    }
+    delete[] slab;
+}
+
+// EpollHttpFrontend 实现
+static uint32_t monotonicSeconds() {
+    return static_cast<uint32_t>(duration_cast<seconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+static const char* httpStatusText(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default: return "Unknown";
+    }
+}
+
+static std::string decodeUrl(const std::string& s, bool plusAsSpace) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '%' && i + 2 < s.size() && std::isxdigit(static_cast<unsigned char>(s[i + 1])) &&
+            std::isxdigit(static_cast<unsigned char>(s[i + 2]))) {
+            out += static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else if (plusAsSpace && s[i] == '+') {
+            out += ' ';
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+// 在非阻塞套接字上写完所有数据, 发送缓冲满时等待可写
+static bool sendAll(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = static_cast<size_t>(count);
+        ssize_t n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            struct pollfd pfd{fd, POLLOUT, 0};
+            if (::poll(&pfd, 1, 30000) <= 0 || (pfd.revents & (POLLERR | POLLHUP))) return false;
+            continue;
+        }
+        size_t written = static_cast<size_t>(n);
+        while (count > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+EpollHttpFrontend::EpollHttpFrontend(HttpHandler handler, std::shared_ptr<LoggingService> logger,
+                                     const ServerConfig& config)
+    : handler_(std::move(handler)), logger_(logger), maxRequestBytes_(config.maxRequestBytes),
+      keepAliveTimeoutSec_(static_cast<uint32_t>(config.keepAliveTimeoutSec)),
+      workerCount_(static_cast<size_t>(std::max(1, config.httpThreads))),
+      reusePort_(config.workerProcesses > 1), slabPool_(config.slabSize, 1024) {}
+
+EpollHttpFrontend::~EpollHttpFrontend() {
+    stop();
+}
+
+bool EpollHttpFrontend::start(const std::string& host, int port) {
+    bool v6 = host.find(':') != std::string::npos;
+    listenFd_ = ::socket(v6 ? AF_INET6 : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) return false;
+
+    int yes = 1;
+    ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    // 多进程模式下每个工作进程各自监听同一端口, 由内核分配新连接
+    if (reusePort_) ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+
+    int bound;
+    if (v6) {
+        sockaddr_in6 addr{};
+        addr.sin6_family = AF_INET6;
+        addr.sin6_port = htons(static_cast<uint16_t>(port));
+        if (::inet_pton(AF_INET6, host.c_str(), &addr.sin6_addr) != 1) return false;
+        bound = ::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    } else {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) return false;
+        bound = ::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+    if (bound != 0 || ::listen(listenFd_, SOMAXCONN) != 0) return false;
+
+    epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd_ < 0 || wakeFd_ < 0) return false;
+
+    struct epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = listenFd_;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &ev);
+    ev.data.fd = wakeFd_;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+
+    running_ = true;
+    for (size_t i = 0; i < workerCount_; ++i) {
+        workers_.emplace_back([this]() { workerLoop(); });
+    }
+    loopThread_ = std::thread([this]() { runLoop(); });
+    return true;
+}
+
+void EpollHttpFrontend::stop() {
+    if (running_.exchange(false)) {
+        uint64_t one = 1;
+        if (::write(wakeFd_, &one, sizeof(one)) < 0) {
+            // 事件循环最多在一次 epoll_wait 超时后退出
+        }
+        tasksCv_.notify_all();
+        if (loopThread_.joinable()) loopThread_.join();
+        for (auto& worker : workers_) {
+            if (worker.joinable()) worker.join();
+        }
+        workers_.clear();
+    }
+
+    for (auto& conn : connections_) {
+        if (conn) closeConnection(conn.get());
+    }
+    connections_.clear();
+    for (int* fd : {&listenFd_, &epollFd_, &wakeFd_}) {
+        if (*fd >= 0) ::close(*fd);
+        *fd = -1;
+    }
+}
+
+void EpollHttpFrontend::runLoop() {
+    std::vector<struct epoll_event> events(256);
+    uint32_t lastSweep = monotonicSeconds();
+
+    while (running_) {
+        int n = ::epoll_wait(epollFd_, events.data(), static_cast<int>(events.size()), 1000);
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd_) {
+                acceptConnections();
+            } else if (fd == wakeFd_) {
+                uint64_t count;
+                while (::read(wakeFd_, &count, sizeof(count)) > 0) {}
+                handleCompleted();
+                handleAdopted();
+            } else if (static_cast<size_t>(fd) < connections_.size() && connections_[fd]) {
+                Connection* conn = connections_[fd].get();
+                if (conn->busy) {
+                    // 工作线程仍持有连接, 只做标记, 处理完成后再关闭。
+                    // 此时的 EPOLLRDHUP 也可能只是对端半关闭, 但与断开无法区分,
+                    // 一律按断开处理并取消请求 (见 README "请求截止时间")
+                    conn->peerClosed.store(true, std::memory_order_relaxed);
+                } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    closeConnection(conn);
+                } else {
+                    handleReadable(conn);
+                }
+            }
+        }
+
+        uint32_t now = monotonicSeconds();
+        if (now != lastSweep) {
+            lastSweep = now;
+            sweepIdle();
+        }
+    }
+}
+
+template <typename Connection>
+static void setRemoteAddress(Connection& conn, const sockaddr_storage& addr) {
+    if (addr.ss_family == AF_INET6) {
+        auto* in6 = reinterpret_cast<const sockaddr_in6*>(&addr);
+        conn.family = AF_INET6;
+        conn.remotePort = ntohs(in6->sin6_port);
+        std::memcpy(conn.remoteAddr, &in6->sin6_addr, 16);
+    } else {
+        auto* in4 = reinterpret_cast<const sockaddr_in*>(&addr);
+        conn.family = AF_INET;
+        conn.remotePort = ntohs(in4->sin_port);
+        std::memcpy(conn.remoteAddr, &in4->sin_addr, 4);
+    }
+}
+
+void EpollHttpFrontend::acceptConnections() {
+    while (true) {
+        sockaddr_storage addr{};
+        socklen_t len = sizeof(addr);
+        int fd = ::accept4(listenFd_, reinterpret_cast<sockaddr*>(&addr), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                DARK_LOG(logger_, LogLevel::Warn, "接受连接失败: {}", std::strerror(errno));
+            }
+            return;
+        }
+
+        int yes = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        auto conn = std::make_unique<Connection>();
+        conn->fd = fd;
+        setRemoteAddress(*conn, addr);
+        registerConnection(std::move(conn), EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT);
+    }
+}
+
+void EpollHttpFrontend::registerConnection(std::unique_ptr<Connection> conn, uint32_t events) {
+    int fd = conn->fd;
+    conn->lastActiveSec = monotonicSeconds();
+    if (static_cast<size_t>(fd) >= connections_.size()) {
+        connections_.resize(static_cast<size_t>(fd) * 2 + 1);
+    }
+    connections_[fd] = std::move(conn);
+    connectionCount_.fetch_add(1, std::memory_order_relaxed);
+
+    struct epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void EpollHttpFrontend::adoptConnection(int fd, std::string buffered) {
+    {
+        std::lock_guard<std::mutex> lock(completedMutex_);
+        adopted_.emplace_back(fd, std::move(buffered));
+    }
+    uint64_t one = 1;
+    if (::write(wakeFd_, &one, sizeof(one)) < 0) {
+        // eventfd 计数溢出时事件循环仍会被唤醒
+    }
+}
+
+void EpollHttpFrontend::handleAdopted() {
+    std::vector<std::pair<int, std::string>> adopted;
+    {
+        std::lock_guard<std::mutex> lock(completedMutex_);
+        adopted.swap(adopted_);
+    }
+
+    for (auto& [fd, buffered] : adopted) {
+        if (buffered.size() > maxRequestBytes_ + slabPool_.slabSize()) {
+            ::close(fd);
+            continue;
+        }
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        auto conn = std::make_unique<Connection>();
+        conn->fd = fd;
+        conn->adopted = true;
+        sockaddr_storage addr{};
+        socklen_t len = sizeof(addr);
+        if (::getpeername(fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0) {
+            setRemoteAddress(*conn, addr);
+        }
+        if (buffered.size() <= slabPool_.slabSize()) {
+            conn->buffer = slabPool_.acquire();
+            std::memcpy(conn->buffer, buffered.data(), buffered.size());
+        } else {
+            conn->overflow = std::make_unique<std::string>(std::move(buffered));
+        }
+        conn->used = static_cast<uint32_t>(conn->overflow ? conn->overflow->size() : buffered.size());
+
+        Connection* raw = conn.get();
+        registerConnection(std::move(conn), EPOLLRDHUP | EPOLLONESHOT);
+        if (readRequestHead(raw) != 0) {
+            closeConnection(raw);
+        } else if (raw->expected != 0 && raw->used >= raw->expected) {
+            dispatch(raw);
+        } else {
+            rearm(raw);
+        }
+    }
+}
+
+// 解析请求头, 得出完整请求的长度; 成功或头部未收全返回 0, 否则返回应答的错误状态码
+int EpollHttpFrontend::readRequestHead(Connection* conn) {
+    const char* data = conn->data();
+    const char* end = static_cast<const char*>(::memmem(data, conn->used, "\r\n\r\n", 4));
+    if (!end) {
+        return conn->used < slabPool_.slabSize() ? 0 : 431;   // 头部不允许超过一个 slab
+    }
+
+    size_t headerBytes = static_cast<size_t>(end - data) + 4;
+    size_t contentLength = 0;
+    bool haveContentLength = false;
+    const char* line = static_cast<const char*>(std::memchr(data, '\n', headerBytes)) + 1;
+    while (line < end) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', static_cast<size_t>(end + 2 - line)));
+        std::string header(line, lineEnd ? static_cast<size_t>(lineEnd - line) : 0);
+        size_t colon = header.find(':');
+        if (colon != std::string::npos) {
+            std::string name = header.substr(0, colon);
+            if (equalsIgnoreCase(name, "Content-Length")) {
+                // 只接受单个纯数字的值, 负数、非法或重复的长度一律按 400 拒绝
+                if (haveContentLength) return 400;
+                haveContentLength = true;
+                size_t first = header.find_first_not_of(" \t", colon + 1);
+                size_t last = header.find_last_not_of(" \t\r");
+                if (first == std::string::npos || last == std::string::npos || last < first) return 400;
+                const char* begin = header.data() + first;
+                const char* stop = header.data() + last + 1;
+                auto parsed = std::from_chars(begin, stop, contentLength);
+                if (*begin < '0' || *begin > '9' || parsed.ec != std::errc() || parsed.ptr != stop) return 400;
+            } else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+                return 501;   // 不支持分块上传
+            }
+        }
+        if (!lineEnd) break;
+        line = lineEnd + 1;
+    }
+
+    // 先比较再相加, 避免 headerBytes + contentLength 回绕
+    if (headerBytes > maxRequestBytes_ || contentLength > maxRequestBytes_ - headerBytes) return 413;
+    conn->expected = static_cast<uint32_t>(headerBytes + contentLength);
+    return 0;
+}
+
+void EpollHttpFrontend::handleReadable(Connection* conn) {
+    conn->lastActiveSec = monotonicSeconds();
+    bool peerClosed = false;
+
+    // 边沿触发: 读到 EAGAIN 为止
+    while (true) {
+        if (!conn->buffer && !conn->overflow) {
+            conn->buffer = slabPool_.acquire();
+        }
+
+        size_t capacity = conn->overflow ? conn->overflow->size() : slabPool_.slabSize();
+        if (conn->used == capacity) {
+            if (!conn->overflow) {
+                // 大请求改用独立缓冲, slab 还给池
+                conn->overflow = std::make_unique<std::string>(conn->buffer, conn->used);
+                slabPool_.release(conn->buffer);
+                conn->buffer = nullptr;
+            }
+            size_t want = std::max<size_t>(conn->expected, conn->used * 2);
+            conn->overflow->resize(std::min(want, maxRequestBytes_ + slabPool_.slabSize()));
+            capacity = conn->overflow->size();
+            if (conn->used == capacity) {
+                closeConnection(conn);
+                return;
+            }
+        }
+
+        ssize_t n = ::recv(conn->fd, conn->data() + conn->used, capacity - conn->used, 0);
+        if (n > 0) {
+            conn->used += static_cast<uint32_t>(n);
+            continue;
+        }
+        if (n == 0) {
+            peerClosed = true;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        closeConnection(conn);
+        return;
+    }
+
+    if (conn->expected == 0 && conn->used > 0) {
+        if (int status = readRequestHead(conn)) {
+            std::string reply = "HTTP/1.1 " + std::to_string(status) + " " + httpStatusText(status) +
+                                "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            struct iovec iov{&reply[0], reply.size()};
+            sendAll(conn->fd, &iov, 1);
+            closeConnection(conn);
+            return;
+        }
+    }
+
+    if (conn->expected != 0 && conn->used >= conn->expected) {
+        // 对端半关闭时仍处理已收到的请求, 响应后关闭
+        conn->closeAfterResponse = peerClosed;
+        dispatch(conn);
+        return;
+    }
+
+    if (peerClosed) {
+        closeConnection(conn);
+        return;
+    }
+    releaseBufferIfIdle(conn);
+    rearm(conn);
+}
+
+void EpollHttpFrontend::releaseBufferIfIdle(Connection* conn) {
+    if (conn->used == 0) {
+        slabPool_.release(conn->buffer);
+        conn->buffer = nullptr;
+        conn->overflow.reset();
     }
 }
 
-void ConnectionRegistry::routeMessage(const Message& message, std::shared_ptr<MessageQueue> queue) {
-    const std::string& eventType = message.eventType;
-    
-    if (eventType == "response_headers" || eventType == "chunk" || eventType == "error") {
-        queue->enqueue(message);
-    } else if (eventType == "stream_close") {
-        Message endMsg;
-        endMsg.type = "STREAM_END";
-        queue->enqueue(endMsg);
-    } else {
-        logger_->warn("未知的事件类型: " + eventType);
-    }
+void EpollHttpFrontend::rearm(Connection* conn) {
+    struct epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+    ev.data.fd = conn->fd;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_MOD, conn->fd, &ev);
 }
 
-bool ConnectionRegistry::hasActiveConnections() const {
-    std::lock_guard<std::mutex> lock(connectionsMutex_);
-    return !connections_.empty();
+// 处理期间只关注对端关闭, 不读取后续请求 (流水线请求已在缓冲区中)
+// 已知半关闭的连接仍在等待响应, 只能靠 EPOLLHUP/EPOLLERR 判断
+void EpollHttpFrontend::watchHangup(Connection* conn) {
+    struct epoll_event ev{};
+    ev.events = conn->closeAfterResponse ? EPOLLONESHOT : (EPOLLRDHUP | EPOLLONESHOT);
+    ev.data.fd = conn->fd;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_MOD, conn->fd, &ev);
 }
 
-websocketpp::connection_hdl::type ConnectionRegistry::getFirstConnection() const {
-    std::lock_guard<std::mutex> lock(connectionsMutex_);
-    if (!connections_.empty()) {
-        return *connections_.begin();
+void EpollHttpFrontend::dispatch(Connection* conn) {
+    conn->busy = true;
+    watchHangup(conn);
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        tasks_.push(conn);
     }
-    return websocketpp::connection_hdl::type();
+    tasksCv_.notify_one();
 }
 
-std::shared_ptr<MessageQueue> ConnectionRegistry::createMessageQueue(const std::string& requestId) {
-    auto queue = std::make_shared<MessageQueue>();
-    messageQueues_[requestId] = queue;
-    return queue;
+void EpollHttpFrontend::handleCompleted() {
+    std::vector<Connection*> completed;
+    {
+        std::lock_guard<std::mutex> lock(completedMutex_);
+        completed.swap(completed_);
+    }
+
+    for (Connection* conn : completed) {
+        conn->busy = false;
+        conn->lastActiveSec = monotonicSeconds();
+        if (conn->closeAfterResponse || conn->peerClosed.load(std::memory_order_relaxed)) {
+            closeConnection(conn);
+            continue;
+        }
+        releaseBufferIfIdle(conn);
+        rearm(conn);
+    }
 }
 
-void ConnectionRegistry::removeMessageQueue(const std::string& requestId) {
-    auto it = messageQueues_.find(requestId);
-    if (it != messageQueues_.end()) {
-        it->second->close();
-        messageQueues_.erase(it);
+void EpollHttpFrontend::sweepIdle() {
+    uint32_t now = monotonicSeconds();
+    for (auto& conn : connections_) {
+        if (conn && !conn->busy && now - conn->lastActiveSec > keepAliveTimeoutSec_) {
+            closeConnection(conn.get());
+        }
     }
 }
 
-void ConnectionRegistry::onConnectionAdded(ConnectionCallback callback) {
-    connectionAddedCallbacks_.push_back(callback);
+void EpollHttpFrontend::closeConnection(Connection* conn) {
+    int fd = conn->fd;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    slabPool_.release(conn->buffer);
+    connectionCount_.fetch_sub(1, std::memory_order_relaxed);
+    connections_[fd].reset();
 }
 
-void ConnectionRegistry::onConnectionRemoved(ConnectionCallback callback) {
-    connectionRemovedCallbacks_.push_back(callback);
+void EpollHttpFrontend::workerLoop() {
+    while (true) {
+        Connection* conn;
+        {
+            std::unique_lock<std::mutex> lock(tasksMutex_);
+            tasksCv_.wait(lock, [this] { return !running_ || !tasks_.empty(); });
+            if (!running_) return;
+            conn = tasks_.front();
+            tasks_.pop();
+        }
+
+        serve(conn);
+
+        {
+            std::lock_guard<std::mutex> lock(completedMutex_);
+            completed_.push_back(conn);
+        }
+        uint64_t one = 1;
+        if (::write(wakeFd_, &one, sizeof(one)) < 0) {
+            // eventfd 计数溢出时事件循环仍会被唤醒
+        }
+    }
 }
 
-// RequestHandler 实现
-RequestHandler::RequestHandler(std::shared_ptr<ConnectionRegistry> connectionRegistry,
-                               std::shared_ptr<LoggingService> logger)
-    : connectionRegistry_(connectionRegistry), logger_(logger) {}
+// 在工作线程中处理缓冲区内所有完整的请求 (支持流水线)
+void EpollHttpFrontend::serve(Connection* conn) {
+    while (conn->expected != 0 && conn->used >= conn->expected) {
+        // 连同缓冲区中剩余的字节一起转交, 本进程只关闭自己的描述符副本
+        if (handoff_ && !conn->adopted && handoff_(conn->fd, conn->data(), conn->used)) {
+            conn->closeAfterResponse = true;
+            return;
+        }
 
-void RequestHandler::processRequest(const httplib::Request& req, httplib::Response& res) {
-    logger_->info("处理请求: " + req.method + " " + req.path);
+        const char* data = conn->data();
+        size_t total = conn->expected;
+        const char* headEnd = static_cast<const char*>(::memmem(data, total, "\r\n\r\n", 4));
+        assert(headEnd != nullptr && "readRequestHead 保证 expected 覆盖整个请求头");
+        std::string head(data, static_cast<size_t>(headEnd - data));
+
+        httplib::Request req;
+        httplib::Response res;
+        std::istringstream lines(head);
+        std::string requestLine, target;
+        std::getline(lines, requestLine);
+        std::istringstream parts(requestLine);
+        parts >> req.method >> target >> req.version;
+
+        size_t query = target.find('?');
+        req.path = decodeUrl(target.substr(0, query), false);
+        if (query != std::string::npos) {
+            std::istringstream params(target.substr(query + 1));
+            std::string pair;
+            while (std::getline(params, pair, '&')) {
+                size_t eq = pair.find('=');
+                req.params.emplace(decodeUrl(pair.substr(0, eq), true),
+                                   eq == std::string::npos ? "" : decodeUrl(pair.substr(eq + 1), true));
+            }
+        }
 
-    if (!connectionRegistry_->hasActiveConnections()) {
-        sendErrorResponse(res, 503, "没有可用的浏览器连接");
-        return;
+        std::string line;
+        while (std::getline(lines, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+            req.headers.emplace(line.substr(0, colon),
+                                valueStart == std::string::npos ? "" : line.substr(valueStart));
+        }
+
+        const char* body = headEnd + 4;
+        req.body.assign(body, data + total - body);
+
+        char addr[INET6_ADDRSTRLEN] = {};
+        ::inet_ntop(conn->family, conn->remoteAddr, addr, sizeof(addr));
+        req.remote_addr = addr;
+        req.remote_port = conn->remotePort;
+        req.is_connection_closed = [conn] { return conn->peerClosed.load(std::memory_order_relaxed); };
+
+        std::string connectionHeader = req.get_header_value("Connection");
+        bool keepAlive = (req.version == "HTTP/1.1") ? !equalsIgnoreCase(connectionHeader, "close")
+                                                      : equalsIgnoreCase(connectionHeader, "keep-alive");
+
+        try {
+            handler_(req, res);
+        } catch (const std::exception& e) {
+            DARK_LOG(logger_, LogLevel::Error, "请求处理异常: {}", e.what());
+            res = httplib::Response();
+            res.status = 500;
+        }
+
+        // 消费已处理的请求, 剩余字节属于下一个流水线请求
+        size_t remaining = conn->used - total;
+        std::memmove(conn->data(), conn->data() + total, remaining);
+        conn->used = static_cast<uint32_t>(remaining);
+        conn->expected = 0;
+
+        if (!writeResponse(conn, req, res, keepAlive) || !keepAlive) {
+            conn->closeAfterResponse = true;
+            return;
+        }
+        if (conn->used > 0 && readRequestHead(conn) != 0) {
+            conn->closeAfterResponse = true;
+            return;
+        }
     }
+}
 
-    std::string requestId = generateRequestId();
-    Message proxyRequest = buildProxyRequest(req, requestId);
+bool EpollHttpFrontend::writeResponse(Connection* conn, const httplib::Request& req, httplib::Response& res,
+                                      bool keepAlive) {
+    if (res.status == -1) res.status = 200;
+    bool chunked = res.content_provider_ && res.is_chunked_content_provider_;
+    bool untilClose = res.content_provider_ && !chunked && res.content_length_ == 0;
+    if (untilClose) keepAlive = false;
+
+    std::string head = "HTTP/1.1 " + std::to_string(res.status) + " " + httpStatusText(res.status) + "\r\n";
+    for (const auto& [name, value] : res.headers) {
+        head += name;
+        head += ": ";
+        head += value;
+        head += "\r\n";
+    }
+    if (chunked) {
+        head += "Transfer-Encoding: chunked\r\n";
+    } else if (!untilClose) {
+        size_t length = res.content_provider_ ? res.content_length_ : res.body.size();
+        head += "Content-Length: " + std::to_string(length) + "\r\n";
+    }
+    head += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
 
-    auto messageQueue = connectionRegistry_->createMessageQueue(requestId);
+    bool headOnly = req.method == "HEAD";
+    if (!res.content_provider_) {
+        struct iovec iov[2] = {{&head[0], head.size()}, {&res.body[0], headOnly ? 0 : res.body.size()}};
+        return sendAll(conn->fd, iov, 2);
+    }
 
-    try {
-        forwardRequest(proxyRequest);
-        handleResponse(messageQueue, res);
-    } catch (const std::exception& error) {
-        handleRequestError(error, res);
+    struct iovec iov{&head[0], head.size()};
+    bool ok = sendAll(conn->fd, &iov, 1);
+
+    // 驱动内容提供器, 分块时每次写出用 writev 拼接块头、数据和结尾, 不复制数据
+    bool done = false;
+    size_t offset = 0;
+    httplib::DataSink sink;
+    sink.write = [&](const char* data, size_t len) {
+        if (!ok) return false;
+        if (len == 0) return true;
+        if (chunked) {
+            char size[20];
+            int sizeLen = std::snprintf(size, sizeof(size), "%zx\r\n", len);
+            struct iovec parts[3] = {{size, static_cast<size_t>(sizeLen)},
+                                     {const_cast<char*>(data), len},
+                                     {const_cast<char*>("\r\n"), 2}};
+            ok = sendAll(conn->fd, parts, 3);
+        } else {
+            struct iovec part{const_cast<char*>(data), len};
+            ok = sendAll(conn->fd, &part, 1);
+        }
+        offset += len;
+        return ok;
+    };
+    sink.is_writable = [&]() { return ok && !conn->peerClosed.load(std::memory_order_relaxed); };
+    sink.done = [&]() {
+        if (done) return;
+        done = true;
+        if (chunked && ok) {
+            struct iovec last{const_cast<char*>("0\r\n\r\n"), 5};
+            ok = sendAll(conn->fd, &last, 1);
+        }
+    };
+
+    while (ok && !done && !headOnly) {
+        size_t limit = chunked || untilClose ? 0 : res.content_length_ - offset;
+        if (!chunked && !untilClose && limit == 0) break;
+        if (!res.content_provider_(offset, limit, sink)) {
+            ok = false;
+        }
     }
 
-    connectionRegistry_->removeMessageQueue(requestId);
+    if (res.content_provider_resource_releaser_) {
+        res.content_provider_resource_releaser_(ok && (done || headOnly || !chunked));
+    }
+    return ok && !untilClose;
 }
 
-std::string RequestHandler::generateRequestId() {
-    auto now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+// WorkerDirectory 实现
+WorkerDirectory::WorkerDirectory(size_t workerCount) : workerCount_(std::min(workerCount, kMaxWorkers)) {
+    void* memory = ::mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("无法映射共享连接目录: " + std::string(std::strerror(errno)));
+    }
+    shared_ = new (memory) Shared{};
+}
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(0, 35);
+WorkerDirectory::~WorkerDirectory() {
+    if (shared_) ::munmap(shared_, sizeof(Shared));
+}
 
-    std::string randomStr;
-    for (int i = 0; i < 9; ++i) {
-        char c = (dis(gen) < 10) ? ('0' + dis(gen)) : ('a' + dis(gen) - 10);
-        randomStr += c;
+int WorkerDirectory::addConnection(size_t worker) {
+    uint32_t owner = static_cast<uint32_t>(worker) + 1;
+    for (size_t i = 0; i < kMaxConnections; ++i) {
+        uint32_t expected = 0;
+        if (shared_->owners[i].compare_exchange_strong(expected, owner, std::memory_order_acq_rel)) {
+            shared_->counts[worker].fetch_add(1, std::memory_order_release);
+            return static_cast<int>(i);
+        }
     }
+    return -1;
+}
 
-    return std::to_string(now) + "_" + randomStr;
+void WorkerDirectory::removeConnection(size_t worker, int slot) {
+    uint32_t owner = static_cast<uint32_t>(worker) + 1;
+    if (slot >= 0 && shared_->owners[slot].compare_exchange_strong(owner, 0, std::memory_order_acq_rel)) {
+        shared_->counts[worker].fetch_sub(1, std::memory_order_release);
+    }
 }
 
-Message RequestHandler::buildProxyRequest(const httplib::Request& req, const std::string& requestId) {
-    Message proxyRequest;
-    proxyRequest.requestId = requestId;
-    proxyRequest.type = "proxy_request";
+void WorkerDirectory::clearWorker(size_t worker) {
+    for (size_t i = 0; i < kMaxConnections; ++i) {
+        removeConnection(worker, static_cast<int>(i));
+    }
+}
 
-    // 构建请求数据 (简化版本)
-    json requestData;
-    requestData["path"] = req.path;
-    requestData["method"] = req.method;
-    requestData["request_id"] = requestId;
-    requestData["body"] = req.body;
+size_t WorkerDirectory::connectionCount(size_t worker) const {
+    return shared_->counts[worker].load(std::memory_order_acquire);
+}
 
-    // 添加headers
-    json headers;
-    for (const auto& [name, value] : req.headers) {
-        headers[name] = value;
+int WorkerDirectory::pickOwner(size_t self) {
+    size_t start = shared_->cursor.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < workerCount_; ++i) {
+        size_t worker = (start + i) % workerCount_;
+        if (worker != self && connectionCount(worker) > 0) return static_cast<int>(worker);
     }
-    requestData["headers"] = headers;
+    return -1;
+}
 
-    proxyRequest.data = requestData.dump();
-    return proxyRequest;
+// ConnectionHandoff 实现
+static socklen_t handoffAddress(const std::string& name, size_t worker, sockaddr_un& addr) {
+    // 抽象命名空间: sun_path 以 0 开头, 不在文件系统中留下套接字文件
+    std::string path = name + "-" + std::to_string(worker);
+    addr = sockaddr_un{};
+    addr.sun_family = AF_UNIX;
+    size_t length = std::min(path.size(), sizeof(addr.sun_path) - 1);
+    std::memcpy(addr.sun_path + 1, path.data(), length);
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + length);
 }
 
-void RequestHandler::forwardRequest(const Message& proxyRequest) {
-    // 这里需要通过WebSocket发送请求
-    // 实际实现需要访问WebSocket服务器实例
-    // 暂时留空，需要在ProxyServerSystem中实现
+ConnectionHandoff::ConnectionHandoff(std::string name, size_t worker, size_t maxBytes,
+                                     std::shared_ptr<LoggingService> logger)
+    : name_(std::move(name)), worker_(worker), maxBytes_(maxBytes), logger_(logger) {}
+
+ConnectionHandoff::~ConnectionHandoff() {
+    stop();
 }
 
-void RequestHandler::handleResponse(std::shared_ptr<MessageQueue> messageQueue, httplib::Response& res) {
-    try {
-        // 等待响应头
-        auto headerFuture = messageQueue->dequeue();
-        auto headerMessage = headerFuture.get();
+bool ConnectionHandoff::start(Receiver receiver) {
+    recvFd_ = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    sendFd_ = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (recvFd_ < 0 || sendFd_ < 0) return false;
+
+    // 数据报必须能容纳整个转交的请求
+    int bufferSize = static_cast<int>(maxBytes_ + 4096);
+    ::setsockopt(recvFd_, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    ::setsockopt(sendFd_, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+
+    sockaddr_un addr;
+    socklen_t length = handoffAddress(name_, worker_, addr);
+    if (::bind(recvFd_, reinterpret_cast<sockaddr*>(&addr), length) != 0) {
+        logger_->error("无法绑定连接转交套接字: " + std::string(std::strerror(errno)));
+        return false;
+    }
 
-        if (headerMessage.eventType == "error") {
-            sendErrorResponse(res, headerMessage.status, headerMessage.data);
-            return;
-        }
+    running_ = true;
+    thread_ = std::thread([this, receiver = std::move(receiver)]() { receiveLoop(receiver); });
+    return true;
+}
 
-        // 设置响应头
-        setResponseHeaders(res, headerMessage);
+void ConnectionHandoff::stop() {
+    running_ = false;
+    if (thread_.joinable()) thread_.join();
+    for (int* fd : {&recvFd_, &sendFd_}) {
+        if (*fd >= 0) ::close(*fd);
+        *fd = -1;
+    }
+}
 
-        // 处理流式数据
-        streamResponseData(messageQueue, res);
-    } catch (const std::exception& e) {
-        throw;
+bool ConnectionHandoff::send(size_t worker, int fd, const char* data, size_t size) {
+    if (sendFd_ < 0 || size > maxBytes_) return false;
+
+    sockaddr_un addr;
+    socklen_t length = handoffAddress(name_, worker, addr);
+    struct iovec iov{const_cast<char*>(data), size};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+
+    struct msghdr msg{};
+    msg.msg_name = &addr;
+    msg.msg_namelen = length;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    // 对方接收队列满时放弃转交, 由本进程直接应答
+    if (::sendmsg(sendFd_, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+        DARK_LOG(logger_, LogLevel::Warn, "转交连接到工作进程 {} 失败: {}", worker, std::strerror(errno));
+        return false;
     }
+    return true;
 }
 
-void RequestHandler::setResponseHeaders(httplib::Response& res, const Message& headerMessage) {
-    res.status = headerMessage.status;
+void ConnectionHandoff::receiveLoop(Receiver receiver) {
+    std::string buffer(maxBytes_, '\0');
+    while (running_) {
+        struct pollfd pfd{recvFd_, POLLIN, 0};
+        if (::poll(&pfd, 1, 200) <= 0) continue;
+
+        struct iovec iov{&buffer[0], buffer.size()};
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t n = ::recvmsg(recvFd_, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0) continue;
+
+        int fd = -1;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+            }
+        }
+        if (fd < 0) continue;
+        if (msg.msg_flags & MSG_TRUNC) {
+            ::close(fd);
+            continue;
+        }
+        receiver(fd, std::string(buffer.data(), static_cast<size_t>(n)));
+    }
+}
 
-    for (const auto& [name, value] : headerMessage.headers) {
-        res.set_header(name, value);
+// 多进程模式
+// 每个工作进程写自己的二进制日志和录制文件
+static void applyWorkerSuffix(ServerConfig& config, size_t index) {
+    std::string suffix = "." + std::to_string(index);
+    if (!config.binaryLogPath.empty()) config.binaryLogPath += suffix;
+    if (!config.recordPath.empty()) config.recordPath += suffix;
+}
+
+static void runWorker(ServerConfig config, const std::string& configPath, size_t index,
+                      std::shared_ptr<WorkerDirectory> directory, const std::string& handoffName) {
+    applyWorkerSuffix(config, index);
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+
+    try {
+        ProxyServerSystem serverSystem(config, configPath);
+        serverSystem.setWorker(index, directory, handoffName);
+        serverSystem.start();
+
+        int signal = 0;
+        sigwait(&signals, &signal);
+        serverSystem.stop();
+    } catch (const std::exception& error) {
+        std::cerr << "工作进程 " << index << " 启动失败: " << error.what() << std::endl;
+        std::_Exit(1);
     }
+    std::_Exit(0);
 }
 
-void RequestHandler::streamResponseData(std::shared_ptr<MessageQueue> messageQueue, httplib::Response& res) {
-    std::string responseBody;
+void runWorkerProcesses(const ServerConfig& config, const std::string& configPath) {
+    auto logger = std::make_shared<LoggingService>("Master");
+    size_t workerCount = std::min(static_cast<size_t>(config.workerProcesses), WorkerDirectory::kMaxWorkers);
+    auto directory = std::make_shared<WorkerDirectory>(workerCount);
+    std::string handoffName = "dark-server-" + std::to_string(::getpid());
+
+    // 主进程同步等待信号; 子进程继承屏蔽字, SIGHUP 在子进程中重新放开给热加载线程
+    sigset_t signals;
+    sigemptyset(&signals);
+    for (int signal : {SIGTERM, SIGINT, SIGHUP, SIGCHLD}) sigaddset(&signals, signal);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::vector<pid_t> workers(workerCount, -1);
+    auto spawn = [&](size_t index) {
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            sigset_t reload;
+            sigemptyset(&reload);
+            sigaddset(&reload, SIGHUP);
+            sigaddset(&reload, SIGCHLD);
+            pthread_sigmask(SIG_UNBLOCK, &reload, nullptr);
+            runWorker(config, configPath, index, directory, handoffName);
+        }
+        if (pid < 0) {
+            logger->error("无法创建工作进程: " + std::string(std::strerror(errno)));
+        }
+        workers[index] = pid;
+    };
 
-    while (true) {
-        try {
-            auto dataFuture = messageQueue->dequeue();
-            auto dataMessage = dataFuture.get();
+    for (size_t i = 0; i < workerCount; ++i) spawn(i);
+    logger->info("已启动 " + std::to_string(workerCount) + " 个工作进程");
 
-            if (dataMessage.type == "STREAM_END") {
-                break;
-            }
+    bool stopping = false;
+    while (!stopping) {
+        int signal = 0;
+        if (sigwait(&signals, &signal) != 0) continue;
 
-            if (!dataMessage.data.empty()) {
-                responseBody += dataMessage.data;
+        if (signal == SIGHUP) {
+            for (pid_t pid : workers) {
+                if (pid > 0) ::kill(pid, SIGHUP);
             }
-        } catch (const std::exception& e) {
-            std::string errorMsg = e.what();
-            if (errorMsg.find("timeout") != std::string::npos) {
-                // 处理超时
-                break;
-            } else {
-                throw;
+        } else if (signal == SIGCHLD) {
+            // 清除退出进程登记的浏览器连接; 因信号崩溃的进程重新启动, 启动失败的不再重试
+            pid_t pid;
+            int status = 0;
+            while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+                auto it = std::find(workers.begin(), workers.end(), pid);
+                if (it == workers.end()) continue;
+                size_t index = static_cast<size_t>(it - workers.begin());
+                directory->clearWorker(index);
+                *it = -1;
+                if (WIFSIGNALED(status)) {
+                    logger->warn("工作进程 " + std::to_string(index) + " 被信号 " +
+                                 std::to_string(WTERMSIG(status)) + " 终止, 重新启动");
+                    spawn(index);
+                } else {
+                    logger->error("工作进程 " + std::to_string(index) + " 退出, 退出码 " +
+                                  std::to_string(WEXITSTATUS(status)));
+                }
             }
+            stopping = std::all_of(workers.begin(), workers.end(), [](pid_t pid) { return pid <= 0; });
+        } else {
+            stopping = true;
         }
     }
 
-    res.body = responseBody;
+    for (pid_t pid : workers) {
+        if (pid > 0) ::kill(pid, SIGTERM);
+    }
+    for (pid_t pid : workers) {
+        if (pid > 0) ::waitpid(pid, nullptr, 0);
+    }
+    logger->info("所有工作进程已退出");
 }
+#endif
 
-void RequestHandler::handleRequestError(const std::exception& error, httplib::Response& res) {
-    std::string errorMsg = error.what();
-    if (errorMsg.find("timeout") != std::string::npos) {
-        sendErrorResponse(res, 504, "请求超时");
-    } else {
-        logger_->error("请求处理错误: " + errorMsg);
-        sendErrorResponse(res, 500, "代理错误: " + errorMsg);
+// ProxyServerSystem 实现
+ProxyServerSystem::ProxyServerSystem(const ServerConfig& config, const std::string& configPath)
+    : config_(config), configPath_(configPath), configStore_(std::make_shared<ConfigStore>(config)),
+      logger_(std::make_shared<LoggingService>("ProxyServer")) {
+    logger_->setLevel(config_.logLevel);
+
+    if (!config_.binaryLogPath.empty()) {
+        logger_->enableBinaryLog(config_.binaryLogPath, config_.binaryLogCapacity);
     }
-}
 
-void RequestHandler::sendErrorResponse(httplib::Response& res, int status, const std::string& message) {
-    res.status = status;
-    res.body = message;
-    res.set_header("Content-Type", "text/plain; charset=utf-8");
-}
+    tracer_ = std::make_shared<RequestTracer>(config_.traceSampleEvery, config_.traceRingCapacity);
+    rateLimiter_ = std::make_shared<RateLimiter>(config_.rateLimitPerSecond, config_.rateLimitBurst,
+                                                 config_.rateLimitKeyHeader);
+    connectionRegistry_ = std::make_shared<ConnectionRegistry>(logger_, tracer_);
+
+    if (config_.maxInflightPerConnection > 0) {
+        scheduler_ = std::make_shared<RequestScheduler>(logger_, config_.priorityClasses,
+                                                        config_.maxInflightPerConnection);
+        auto scheduler = scheduler_;
+        connectionRegistry_->onConnectionAdded([scheduler](websocketpp::connection_hdl hdl) {
+            scheduler->addConnection(hdl);
+        });
+        connectionRegistry_->onConnectionRemoved([scheduler](websocketpp::connection_hdl hdl) {
+            scheduler->removeConnection(hdl);
+        });
+    }
 
-// ProxyServerSystem 实现
-ProxyServerSystem::ProxyServerSystem(const ServerConfig& config)
-    : config_(config), logger_(std::make_shared<LoggingService>("ProxyServer")) {
+    requestHandler_ = std::make_shared<RequestHandler>(connectionRegistry_, logger_, tracer_, rateLimiter_,
+                                                       configStore_, scheduler_);
 
-    connectionRegistry_ = std::make_shared<ConnectionRegistry>(logger_);
-    requestHandler_ = std::make_shared<RequestHandler>(connectionRegistry_, logger_);
+    if (!config_.recordPath.empty()) {
+        recorder_ = std::make_shared<TrafficRecorder>(config_.recordPath);
+        if (recorder_->isOpen()) {
+            connectionRegistry_->setTrafficRecorder(recorder_);
+            requestHandler_->setTrafficRecorder(recorder_);
+            logger_->info("流量录制已开启: " + config_.recordPath);
+        } else {
+            logger_->error("无法打开录制文件: " + config_.recordPath);
+        }
+    }
 }
 
 ProxyServerSystem::~ProxyServerSystem() {
     stop();
 }
 
+#ifdef __linux__
+void ProxyServerSystem::setWorker(size_t index, std::shared_ptr<WorkerDirectory> directory,
+                                  const std::string& handoffName) {
+    workerIndex_ = index;
+    workerDirectory_ = std::move(directory);
+    handoff_ = std::make_unique<ConnectionHandoff>(handoffName, index, config_.maxHandoffBytes, logger_);
+
+    connectionRegistry_->onConnectionAdded([this](websocketpp::connection_hdl hdl) {
+        int slot = workerDirectory_->addConnection(workerIndex_);
+        std::lock_guard<std::mutex> lock(directorySlotsMutex_);
+        directorySlots_[hdl] = slot;
+    });
+    connectionRegistry_->onConnectionRemoved([this](websocketpp::connection_hdl hdl) {
+        std::lock_guard<std::mutex> lock(directorySlotsMutex_);
+        auto it = directorySlots_.find(hdl);
+        if (it == directorySlots_.end()) return;
+        workerDirectory_->removeConnection(workerIndex_, it->second);
+        directorySlots_.erase(it);
+    });
+}
+
+bool ProxyServerSystem::handOffConnection(int fd, const char* buffered, size_t size) {
+    if (connectionRegistry_->hasActiveConnections()) return false;
+    int owner = workerDirectory_->pickOwner(workerIndex_);
+    if (owner < 0) return false;
+    if (!handoff_->send(static_cast<size_t>(owner), fd, buffered, size)) return false;
+    DARK_LOG(logger_, LogLevel::Debug, "本进程没有浏览器连接, 请求连接已转交工作进程 {}", owner);
+    return true;
+}
+#endif
+
 void ProxyServerSystem::start() {
     try {
         running_ = true;
 
         startHttpServer();
         startWebSocketServer();
+        if (!configPath_.empty()) {
+            reloadThread_ = std::thread([this]() { watchReloadSignal(); });
+        }
 
         logger_->info("代理服务器系统启动完成");
 
@@ -432,10 +2984,25 @@ void ProxyServerSystem::stop() {
         httpServer_->stop();
     }
 
+#ifdef __linux__
+    if (handoff_) {
+        handoff_->stop();
+    }
+    if (epollFrontend_) {
+        epollFrontend_->stop();
+    }
+#endif
+
     if (wsServer_) {
         wsServer_->stop();
     }
 
+#ifdef DARK_SERVER_TLS
+    if (wssServer_) {
+        wssServer_->stop();
+    }
+#endif
+
     if (httpThread_.joinable()) {
         httpThread_.join();
     }
@@ -444,16 +3011,179 @@ void ProxyServerSystem::stop() {
         wsThread_.join();
     }
 
+    if (reloadThread_.joinable()) {
+        reloadThread_.join();
+    }
+
+    const PayloadCopyStats& stats = connectionRegistry_->copyStats();
+    DARK_LOG(logger_, LogLevel::Info, "转发响应数据 {} 字节, 转发途中复制 {} 字节, 每字节复制 {} 次",
+             stats.proxiedBytes.load(), stats.copiedBytes.load(), stats.copiesPerProxiedByte());
+    const FrameParseStats& parseStats = connectionRegistry_->parseStats();
+    DARK_LOG(logger_, LogLevel::Info, "浏览器消息 {} 条, 丢弃 {} 条", parseStats.accepted.load(),
+             parseStats.rejectedTotal());
     logger_->info("代理服务器系统已停止");
 }
 
+// SIGHUP 处理函数只置位, 实际的重新加载在 watchReloadSignal 线程中进行
+static std::atomic<bool> reloadRequested{false};
+
+static void handleReloadSignal(int) {
+    reloadRequested.store(true);
+}
+
+void ProxyServerSystem::watchReloadSignal() {
+#ifdef SIGHUP
+    std::signal(SIGHUP, handleReloadSignal);
+#endif
+    while (running_) {
+        if (reloadRequested.exchange(false)) {
+            reloadConfig();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+}
+
+void ProxyServerSystem::reloadConfig() {
+    if (configPath_.empty()) return;
+
+    ServerConfig next;
+    std::string error;
+    if (!loadServerConfig(configPath_, next, error)) {
+        logger_->error("重新加载配置失败: " + error);
+        return;
+    }
+
+#ifdef __linux__
+    if (workerDirectory_) applyWorkerSuffix(next, workerIndex_);
+#endif
+
+    // 需要重启才能生效的字段保持启动时的值
+    const ServerConfig& current = configStore_->current();
+    if (next.httpPort != current.httpPort || next.wsPort != current.wsPort || next.host != current.host ||
+        next.httpThreads != current.httpThreads || next.binaryLogPath != current.binaryLogPath ||
+        next.traceEndpoint != current.traceEndpoint || next.rateLimitKeyHeader != current.rateLimitKeyHeader ||
+        next.epollFrontend != current.epollFrontend || next.keepAliveTimeoutSec != current.keepAliveTimeoutSec ||
+        next.maxRequestBytes != current.maxRequestBytes || next.slabSize != current.slabSize ||
+        next.recordPath != current.recordPath || next.maxInflightPerConnection != current.maxInflightPerConnection ||
+        next.tlsCertFile != current.tlsCertFile || next.tlsKeyFile != current.tlsKeyFile ||
+        next.workerProcesses != current.workerProcesses) {
+        logger_->warn("端口、监听地址、线程数、HTTP 前端、二进制日志、追踪端点、限流键、录制文件、TLS、优先级调度和工作进程数的修改需要重启后生效");
+    }
+    next.httpPort = current.httpPort;
+    next.wsPort = current.wsPort;
+    next.host = current.host;
+    next.httpThreads = current.httpThreads;
+    next.binaryLogPath = current.binaryLogPath;
+    next.binaryLogCapacity = current.binaryLogCapacity;
+    next.traceRingCapacity = current.traceRingCapacity;
+    next.traceEndpoint = current.traceEndpoint;
+    next.rateLimitKeyHeader = current.rateLimitKeyHeader;
+    next.epollFrontend = current.epollFrontend;
+    next.keepAliveTimeoutSec = current.keepAliveTimeoutSec;
+    next.maxRequestBytes = current.maxRequestBytes;
+    next.slabSize = current.slabSize;
+    next.recordPath = current.recordPath;
+    next.maxInflightPerConnection = current.maxInflightPerConnection;
+    next.priorityClasses = current.priorityClasses;
+    next.tlsCertFile = current.tlsCertFile;
+    next.tlsKeyFile = current.tlsKeyFile;
+    next.tlsSessionTickets = current.tlsSessionTickets;
+    next.tlsKtls = current.tlsKtls;
+    next.workerProcesses = current.workerProcesses;
+    next.maxHandoffBytes = current.maxHandoffBytes;
+
+    configStore_->publish(next);
+    applyRuntimeConfig(next);
+    logger_->info("配置已重新加载: " + configPath_);
+}
+
+void ProxyServerSystem::applyRuntimeConfig(const ServerConfig& config) {
+    logger_->setLevel(config.logLevel);
+    rateLimiter_->setLimits(config.rateLimitPerSecond, config.rateLimitBurst);
+    tracer_->setSampleEvery(config.traceSampleEvery);
+}
+
+#ifdef DARK_SERVER_TLS
+// HTTP 和 WebSocket 共用的 TLS 参数; 每个监听使用一个 SSL_CTX, 会话缓存和票据在其连接间共享
+static void configureTlsContext(SSL_CTX* ctx, const ServerConfig& config) {
+    static const unsigned char kSessionIdContext[] = "dark-server";
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx, kSessionIdContext, sizeof(kSessionIdContext) - 1);
+
+    if (config.tlsSessionTickets) {
+        SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+    } else {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    }
+
+#ifdef SSL_OP_ENABLE_KTLS
+    if (config.tlsKtls) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+}
+#endif
+
 void ProxyServerSystem::startHttpServer() {
-    httpServer_ = std::make_unique<httplib::Server>();
+#ifdef __linux__
+    if (config_.epollFrontend && tlsEnabled()) {
+        logger_->warn("epoll HTTP 前端不支持 TLS, 改用 httplib");
+    }
+    if (config_.epollFrontend && !tlsEnabled()) {
+        epollFrontend_ = std::make_unique<EpollHttpFrontend>(
+            [this](const httplib::Request& req, httplib::Response& res) { routeHttpRequest(req, res); },
+            logger_, config_);
+        if (handoff_) {
+            epollFrontend_->setHandoff([this](int fd, const char* buffered, size_t size) {
+                return handOffConnection(fd, buffered, size);
+            });
+            EpollHttpFrontend* frontend = epollFrontend_.get();
+            if (!handoff_->start([frontend](int fd, std::string buffered) {
+                    frontend->adoptConnection(fd, std::move(buffered));
+                })) {
+                throw std::runtime_error("连接转交通道启动失败");
+            }
+        }
+        if (!epollFrontend_->start(config_.host, config_.httpPort)) {
+            throw std::runtime_error("HTTP服务器启动失败");
+        }
+        logger_->info("HTTP服务器启动 (epoll): http://" + config_.host + ":" + std::to_string(config_.httpPort));
+        return;
+    }
+#endif
+
+    if (tlsEnabled()) {
+#ifdef DARK_SERVER_TLS
+        auto server = std::make_unique<httplib::SSLServer>(config_.tlsCertFile.c_str(), config_.tlsKeyFile.c_str());
+        if (!server->is_valid()) {
+            throw std::runtime_error("TLS 证书或私钥加载失败");
+        }
+        configureTlsContext(server->ssl_context(), config_);
+        httpServer_ = std::move(server);
+#else
+        throw std::runtime_error("配置了 TLS 证书, 但编译时未启用 DARK_SERVER_TLS");
+#endif
+    } else {
+        httpServer_ = std::make_unique<httplib::Server>();
+    }
+    size_t threads = static_cast<size_t>(config_.httpThreads);
+    httpServer_->new_task_queue = [threads] { return new httplib::ThreadPool(threads); };
+#ifdef __linux__
+    // httplib 无法交出已接受的连接, 多进程模式下只共享端口, 没有浏览器连接的进程直接返回 503
+    if (config_.workerProcesses > 1) {
+        httpServer_->set_socket_options([](httplib::socket_t sock) {
+            int yes = 1;
+            ::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+            ::setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+        });
+    }
+#endif
     setupHttpRoutes();
 
     httpThread_ = std::thread([this]() {
         std::string address = config_.host + ":" + std::to_string(config_.httpPort);
-        logger_->info("HTTP服务器启动: http://" + address);
+        logger_->info(std::string("HTTP服务器启动: ") + (tlsEnabled() ? "https://" : "http://") + address);
 
         if (!httpServer_->listen(config_.host, config_.httpPort)) {
             throw std::runtime_error("HTTP服务器启动失败");
@@ -465,24 +3195,60 @@ void ProxyServerSystem::startHttpServer() {
 }
 
 void ProxyServerSystem::startWebSocketServer() {
-    using WSServer = websocketpp::server<websocketpp::config::asio>;
+    if (tlsEnabled()) {
+#ifdef DARK_SERVER_TLS
+        using SslContext = websocketpp::lib::asio::ssl::context;
+        // 所有连接共用一个上下文, 否则会话缓存和票据无法跨连接复用
+        auto context = std::make_shared<SslContext>(SslContext::tls_server);
+        context->set_options(SslContext::default_workarounds | SslContext::no_sslv2 | SslContext::no_sslv3 |
+                             SslContext::single_dh_use);
+        context->use_certificate_chain_file(config_.tlsCertFile);
+        context->use_private_key_file(config_.tlsKeyFile, SslContext::pem);
+        configureTlsContext(context->native_handle(), config_);
+
+        wssServer_ = std::make_unique<websocketpp::server<websocketpp::config::asio_tls>>();
+        wssServer_->set_tls_init_handler([context](websocketpp::connection_hdl) { return context; });
+        runWebSocketServer(*wssServer_, "wss://");
+        return;
+#else
+        throw std::runtime_error("配置了 TLS 证书, 但编译时未启用 DARK_SERVER_TLS");
+#endif
+    }
+
+    wsServer_ = std::make_unique<websocketpp::server<websocketpp::config::asio>>();
+    runWebSocketServer(*wsServer_, "ws://");
+}
+
+template <typename WSServer>
+void ProxyServerSystem::runWebSocketServer(WSServer& server, const char* scheme) {
+    setupWebSocketHandlers(server);
 
-    wsServer_ = std::make_unique<WSServer>();
-    setupWebSocketHandlers();
+    requestHandler_->setMessageSender([&server](websocketpp::connection_hdl hdl, const std::string& payload) {
+        server.send(hdl, payload, websocketpp::frame::opcode::text);
+    });
 
-    wsThread_ = std::thread([this]() {
+    wsThread_ = std::thread([this, &server, scheme]() {
         try {
-            wsServer_->set_access_channels(websocketpp::log::alevel::all);
-            wsServer_->clear_access_channels(websocketpp::log::alevel::frame_payload);
-            wsServer_->init_asio();
+            server.set_access_channels(websocketpp::log::alevel::all);
+            server.clear_access_channels(websocketpp::log::alevel::frame_payload);
+            server.init_asio();
+#ifdef __linux__
+            if (config_.workerProcesses > 1) {
+                server.set_tcp_pre_bind_handler([](auto acceptor) {
+                    int yes = 1;
+                    ::setsockopt(acceptor->native_handle(), SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+                    return websocketpp::lib::error_code();
+                });
+            }
+#endif
 
-            wsServer_->listen(config_.wsPort);
-            wsServer_->start_accept();
+            server.listen(config_.wsPort);
+            server.start_accept();
 
             std::string address = config_.host + ":" + std::to_string(config_.wsPort);
-            logger_->info("WebSocket服务器启动: ws://" + address);
+            logger_->info("WebSocket服务器启动: " + std::string(scheme) + address);
 
-            wsServer_->run();
+            server.run();
         } catch (const std::exception& e) {
             logger_->error("WebSocket服务器错误: " + std::string(e.what()));
         }
@@ -493,6 +3259,13 @@ void ProxyServerSystem::setupHttpRoutes() {
     // 处理所有HTTP请求
     httpServer_->set_mount_point("/", ".");
 
+    // 追踪导出端点, 需先于通配路由注册
+    if (!config_.traceEndpoint.empty()) {
+        httpServer_->Get(config_.traceEndpoint, [this](const httplib::Request&, httplib::Response& res) {
+            res.set_content(tracer_->dumpChromeTrace(), "application/json");
+        });
+    }
+
     // 通用请求处理器
     auto handler = [this](const httplib::Request& req, httplib::Response& res) {
         requestHandler_->processRequest(req, res);
@@ -505,11 +3278,18 @@ void ProxyServerSystem::setupHttpRoutes() {
     httpServer_->Patch(".*", handler);
 }
 
-void ProxyServerSystem::setupWebSocketHandlers() {
-    using WSServer = websocketpp::server<websocketpp::config::asio>;
+void ProxyServerSystem::routeHttpRequest(const httplib::Request& req, httplib::Response& res) {
+    if (!config_.traceEndpoint.empty() && req.method == "GET" && req.path == config_.traceEndpoint) {
+        res.set_content(tracer_->dumpChromeTrace(), "application/json");
+        return;
+    }
+    requestHandler_->processRequest(req, res);
+}
 
+template <typename WSServer>
+void ProxyServerSystem::setupWebSocketHandlers(WSServer& server) {
     // 连接建立处理
-    wsServer_->set_open_handler([this](websocketpp::connection_hdl hdl) {
+    server.set_open_handler([this](websocketpp::connection_hdl hdl) {
         ClientInfo clientInfo;
         clientInfo.address = "unknown"; // 简化版本
         clientInfo.connectTime = system_clock::now();
@@ -518,13 +3298,14 @@ void ProxyServerSystem::setupWebSocketHandlers() {
     });
 
     // 连接关闭处理
-    wsServer_->set_close_handler([this](websocketpp::connection_hdl hdl) {
+    server.set_close_handler([this](websocketpp::connection_hdl hdl) {
         connectionRegistry_->removeConnection(hdl);
     });
 
     // 消息处理
-    wsServer_->set_message_handler([this](websocketpp::connection_hdl hdl, WSServer::message_ptr msg) {
-        connectionRegistry_->handleIncomingMessage(msg->get_payload());
+    server.set_message_handler([this](websocketpp::connection_hdl, typename WSServer::message_ptr msg) {
+        // 接管帧缓冲, chunk 数据从这里一直引用到 HTTP 写出
+        connectionRegistry_->handleIncomingMessage(std::make_shared<std::string>(std::move(msg->get_raw_payload())));
     });
 }
 
@@ -537,9 +3318,24 @@ void ProxyServerSystem::onError(std::function<void(const std::string&)> callback
 }
 
 // 初始化函数
-void initializeServer() {
+void initializeServer(const std::string& configPath) {
     try {
-        ProxyServerSystem serverSystem;
+        ServerConfig config;
+        if (!configPath.empty()) {
+            std::string error;
+            if (!loadServerConfig(configPath, config, error)) {
+                throw std::runtime_error(error);
+            }
+        }
+
+#ifdef __linux__
+        if (config.workerProcesses > 1) {
+            runWorkerProcesses(config, configPath);
+            return;
+        }
+#endif
+
+        ProxyServerSystem serverSystem(config, configPath);
 
         serverSystem.onStarted([]() {
             std::cout << "服务器启动成功!" << std::endl;
@@ -565,7 +3361,11 @@ void initializeServer() {
 } // namespace DarkServer
 
 // 主函数
-int main() {
-    DarkServer::initializeServer();
+// 用法: dark-server [config.json]
+// 模糊测试等需要链接本文件的工具定义 DARK_SERVER_NO_MAIN
+#ifndef DARK_SERVER_NO_MAIN
+int main(int argc, char* argv[]) {
+    DarkServer::initializeServer(argc > 1 ? argv[1] : "");
     return 0;
 }
+#endif
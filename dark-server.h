@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <vector>
 #include <map>
@@ -9,43 +10,333 @@
 #include <functional>
 #include <mutex>
 #include <condition_variable>
-#include <future>
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
 
 // Forward declarations
 namespace httplib { class Server; class Request; class Response; }
-namespace websocketpp { 
-    namespace config { namespace asio { struct server; } }
+#include <websocketpp/common/connection_hdl.hpp>
+namespace websocketpp {
+    namespace config { struct asio; struct asio_tls; }
     template<typename config> class server;
-    namespace connection_hdl { typedef std::weak_ptr<void> type; }
 }
 
 namespace DarkServer {
 
+// 日志级别
+enum class LogLevel : uint8_t { Debug = 0, Info = 1, Warn = 2, Error = 3 };
+
+const char* logLevelName(LogLevel level);
+
+// 日志格式注册表：每个调用点注册一次静态格式，之后只引用格式ID
+class LogFormatRegistry {
+public:
+    static constexpr uint16_t kMaxFormats = 4096;
+
+    static LogFormatRegistry& instance();
+
+    uint16_t registerFormat(LogLevel level, const char* format);
+    LogLevel level(uint16_t formatId) const;
+    const char* format(uint16_t formatId) const;
+
+private:
+    struct Entry {
+        LogLevel level;
+        const char* format;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<Entry> entries_;
+};
+
+// 二进制日志文件布局 (dark-log-decode 解码):
+//   BinaryLogFileHeader | 格式区 [headerSize 按8字节对齐, formatAreaEnd) | 环形记录区 [formatAreaEnd, capacity)
+//   记录 = BinaryLogRecordHeader + 负载, 按8字节对齐; size 为 0 表示记录未写完
+//   格式区只追加格式记录, 不会被覆盖; 环形区写满后从头覆盖最旧的记录。
+//   sequence 是记录在环形区中的逻辑位置 (只增不减), sequence % 环形区大小
+//   即其物理偏移, 解码器按它找出最旧的记录并排序
+constexpr char kBinaryLogMagic[8] = {'D', 'S', 'B', 'L', 'O', 'G', '1', '\0'};
+
+struct BinaryLogFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t capacity;
+    uint64_t anchorSteadyNs;   // 打开文件时的 steady_clock
+    uint64_t anchorSystemNs;   // 同一时刻的 system_clock, 用于还原墙上时间
+    uint64_t formatAreaEnd;    // 格式区结束、环形区开始的文件偏移
+    uint64_t writePosition;    // 关闭时写入: 环形区的逻辑写入位置
+    uint64_t droppedRecords;   // 关闭时写入
+    char serviceName[32];
+};
+
+enum class BinaryLogRecordKind : uint8_t { Format = 0, Event = 1 };
+
+struct BinaryLogRecordHeader {
+    uint32_t size;             // 含头部, 最后写入
+    uint16_t formatId;
+    uint8_t kind;
+    uint8_t argCount;
+    uint64_t timestampNs;      // steady_clock 纳秒
+    uint64_t sequence;         // 环形区中的逻辑位置; 格式区中的记录为 0
+};
+
+enum class BinaryLogArgType : uint8_t { Int = 1, UInt = 2, Double = 3, String = 4 };
+
+// 二进制日志写入器：基于内存映射文件的环形缓冲, 通过原子逻辑位置无锁分配记录空间
+class BinaryLogWriter {
+public:
+    BinaryLogWriter(const std::string& path, size_t capacityBytes, const std::string& serviceName);
+    ~BinaryLogWriter();
+
+    bool isOpen() const { return base_ != nullptr; }
+
+    // 分配一条事件记录的空间, 环形区满时覆盖最旧的记录;
+    // 只有单条记录大于整个环形区时返回 nullptr 并计入丢弃数
+    char* reserve(uint16_t formatId, uint8_t argCount, size_t payloadSize);
+    void commit(char* record, size_t payloadSize);
+
+    uint64_t droppedRecords() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    std::string path_;
+    char* base_ = nullptr;
+    size_t capacity_ = 0;
+    int fd_ = -1;
+    size_t formatAreaEnd_ = 0;
+    size_t ringSize_ = 0;
+    std::atomic<size_t> formatOffset_{0};
+    std::atomic<uint64_t> position_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::unique_ptr<std::atomic<bool>[]> formatWritten_;
+
+    char* allocate(size_t recordSize, uint64_t& sequence);
+    void writeFormatRecord(uint16_t formatId);
+};
+
+namespace detail {
+
+template <typename T>
+size_t binaryArgSize(const T& value) {
+    if constexpr (std::is_arithmetic_v<T>) {
+        return 1 + sizeof(uint64_t);
+    } else {
+        return 1 + sizeof(uint32_t) + std::string_view(value).size();
+    }
+}
+
+template <typename T>
+void encodeBinaryArg(char*& out, const T& value) {
+    if constexpr (std::is_floating_point_v<T>) {
+        double v = static_cast<double>(value);
+        *out++ = static_cast<char>(BinaryLogArgType::Double);
+        std::memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        int64_t v = static_cast<int64_t>(value);
+        *out++ = static_cast<char>(BinaryLogArgType::Int);
+        std::memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
+    } else if constexpr (std::is_integral_v<T>) {
+        uint64_t v = static_cast<uint64_t>(value);
+        *out++ = static_cast<char>(BinaryLogArgType::UInt);
+        std::memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
+    } else {
+        std::string_view sv(value);
+        uint32_t len = static_cast<uint32_t>(sv.size());
+        *out++ = static_cast<char>(BinaryLogArgType::String);
+        std::memcpy(out, &len, sizeof(len));
+        out += sizeof(len);
+        std::memcpy(out, sv.data(), len);
+        out += len;
+    }
+}
+
+template <typename T>
+void appendTextArg(std::string& out, const T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+        out += value ? "true" : "false";
+    } else if constexpr (std::is_arithmetic_v<T>) {
+        out += std::to_string(value);
+    } else {
+        out += std::string_view(value);
+    }
+}
+
+// 按顺序替换格式串中的 "{}"
+template <typename... Args>
+std::string renderFormat(const char* format, const Args&... args) {
+    std::string out;
+    const char* p = format;
+    [[maybe_unused]] auto next = [&out, &p](const auto& arg) {
+        const char* slot = std::strstr(p, "{}");
+        if (!slot) return;
+        out.append(p, slot);
+        appendTextArg(out, arg);
+        p = slot + 2;
+    };
+    (next(args), ...);
+    out += p;
+    return out;
+}
+
+} // namespace detail
+
 // 日志记录器类
 class LoggingService {
 public:
     explicit LoggingService(const std::string& serviceName = "ProxyServer");
     
+    void setLevel(LogLevel level) { minLevel_.store(level, std::memory_order_relaxed); }
+    bool shouldLog(LogLevel level) const { return level >= minLevel_.load(std::memory_order_relaxed); }
+    
     void info(const std::string& message);
     void error(const std::string& message);
     void warn(const std::string& message);
     void debug(const std::string& message);
 
+    // 切换到二进制日志模式, 之后所有日志写入映射文件而不再格式化
+    bool enableBinaryLog(const std::string& path, size_t capacityBytes);
+    void disableBinaryLog();
+    bool binaryLogEnabled() const { return binaryLog_ != nullptr; }
+
+    // 结构化日志入口, 通常通过 DARK_LOG 宏调用
+    template <typename... Args>
+    void log(LogLevel level, uint16_t formatId, const Args&... args) {
+        if (!shouldLog(level)) return;
+        if (BinaryLogWriter* writer = binaryLog_) {
+            size_t payloadSize = (size_t{0} + ... + detail::binaryArgSize(args));
+            char* record = writer->reserve(formatId, static_cast<uint8_t>(sizeof...(Args)), payloadSize);
+            if (!record) return;
+            [[maybe_unused]] char* out = record + sizeof(BinaryLogRecordHeader);
+            (detail::encodeBinaryArg(out, args), ...);
+            writer->commit(record, payloadSize);
+            return;
+        }
+        writeText(level, detail::renderFormat(LogFormatRegistry::instance().format(formatId), args...));
+    }
+
 private:
     std::string serviceName_;
+    std::atomic<LogLevel> minLevel_{LogLevel::Debug};
+    std::unique_ptr<BinaryLogWriter> binaryLogOwner_;
+    BinaryLogWriter* binaryLog_ = nullptr;
+
     std::string formatMessage(const std::string& level, const std::string& message);
+    void writeText(LogLevel level, const std::string& message);
+};
+
+// 在调用点注册静态格式ID并写日志, 例如:
+//   DARK_LOG(logger_, LogLevel::Info, "处理请求: {} {}", req.method, req.path);
+#define DARK_LOG(logger, level, format, ...)                                                   \
+    do {                                                                                       \
+        static const uint16_t darkLogFormatId_ =                                               \
+            ::DarkServer::LogFormatRegistry::instance().registerFormat(level, format);         \
+        (logger)->log(level, darkLogFormatId_, ##__VA_ARGS__);                                 \
+    } while (0)
+
+// 引用计数的只读字节切片: chunk 数据从收到的 WebSocket 帧一直引用到 HTTP 写出, 中途不复制
+class PayloadBuffer {
+public:
+    PayloadBuffer() = default;
+    PayloadBuffer(std::shared_ptr<const std::string> storage, size_t offset, size_t length)
+        : storage_(std::move(storage)), offset_(offset), length_(length) {}
+    explicit PayloadBuffer(std::string data)
+        : storage_(std::make_shared<const std::string>(std::move(data))), offset_(0), length_(storage_->size()) {}
+
+    const char* data() const { return storage_ ? storage_->data() + offset_ : ""; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    std::string str() const { return std::string(data(), length_); }
+
+private:
+    std::shared_ptr<const std::string> storage_;
+    size_t offset_ = 0;
+    size_t length_ = 0;
+};
+
+// 转发途中的字节复制统计, copiesPerProxiedByte 为每个转发字节被本服务复制的次数
+struct PayloadCopyStats {
+    std::atomic<uint64_t> proxiedBytes{0};
+    std::atomic<uint64_t> copiedBytes{0};
+
+    double copiesPerProxiedByte() const {
+        uint64_t proxied = proxiedBytes.load(std::memory_order_relaxed);
+        return proxied ? static_cast<double>(copiedBytes.load(std::memory_order_relaxed)) / proxied : 0.0;
+    }
+};
+
+// 浏览器消息被丢弃的原因
+enum class FrameError : uint8_t {
+    None = 0,
+    NotObject,          // 顶层不是 JSON 对象
+    Malformed,          // 字段名、冒号、逗号或值的语法错误
+    Unterminated,       // 字符串或对象未结束
+    BadEscape,          // 无效的转义序列
+    WrongType,          // request_id / event_type / data 不是字符串
+    BadStatus,          // status 不是 int 范围内的整数
+    MissingRequestId,
+    UnknownEvent,
+    UnknownRequest,     // 请求已结束或从未存在
+    Count
+};
+
+const char* frameErrorName(FrameError error);
+
+// 浏览器消息解析统计, 按原因分别计数
+struct FrameParseStats {
+    std::atomic<uint64_t> accepted{0};
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(FrameError::Count)> rejected{};
+
+    uint64_t rejectedTotal() const {
+        uint64_t total = 0;
+        for (const auto& count : rejected) total += count.load(std::memory_order_relaxed);
+        return total;
+    }
+};
+
+// 日志限频: 每个时间窗口只放行一条, 其余只计数, 在下一条放行的日志中汇报
+class LogThrottle {
+public:
+    explicit LogThrottle(uint64_t intervalMs = 1000) : intervalMs_(intervalMs) {}
+
+    // 返回 true 时应输出日志, suppressed 为上次输出以来被省略的条数
+    bool allow(uint64_t& suppressed);
+
+private:
+    uint64_t intervalMs_;
+    std::atomic<uint64_t> nextMs_{0};
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+// 浏览器事件类型: 解析时把 event_type 名称驻留为编号, 之后不再比较字符串
+// 插件通过 ConnectionRegistry::registerEventHandler 注册的类型从 FirstCustom 开始编号
+enum class EventType : uint8_t {
+    Unknown = 0,
+    ResponseHeaders,
+    Chunk,
+    StreamClose,
+    Error,
+    Progress,
+    FirstCustom
 };
 
 // 消息结构
 struct Message {
     std::string type;
-    std::string data;
+    std::string data;           // 发往浏览器的请求内容
+    PayloadBuffer payload;      // 浏览器发回的 data 字段, 引用原始帧
     std::map<std::string, std::string> headers;
     int status = 200;
-    std::string eventType;
+    EventType event = EventType::Unknown;
+    bool endOfStream = false;   // stream_close 到达, 之后不会再有数据
     std::string requestId;
 };
 
@@ -56,17 +347,45 @@ public:
     ~MessageQueue();
     
     void enqueue(const Message& message);
-    std::future<Message> dequeue(std::chrono::milliseconds timeoutMs = std::chrono::milliseconds(0));
+    void enqueue(Message&& message);
+    // 阻塞等待下一条消息, 超时抛出 "Queue timeout", 0 表示使用默认超时
+    Message pop(std::chrono::milliseconds timeoutMs = std::chrono::milliseconds(0));
+    // 等待到 deadline, 超时返回 false, 队列关闭时抛出异常
+    bool popUntil(Message& message, std::chrono::steady_clock::time_point deadline);
     void close();
     bool isClosed() const;
 
+    // 记录请求被转发到的浏览器连接; takeOwner 只返回一次, 保证取消事件最多发送一次
+    void setOwner(websocketpp::connection_hdl owner);
+    websocketpp::connection_hdl takeOwner();
+
 private:
     mutable std::mutex mutex_;
     std::condition_variable cv_;
     std::queue<Message> messages_;
-    std::queue<std::promise<Message>> waitingPromises_;
     std::chrono::milliseconds defaultTimeout_;
     std::atomic<bool> closed_{false};
+    websocketpp::connection_hdl owner_;
+};
+
+// SSE 事件合并器: 缓冲到达的数据块, 只在事件边界 (空行) 处切分输出
+class SseCoalescer {
+public:
+    void append(const char* data, size_t size);
+
+    bool hasCompleteEvents() const { return completeEnd_ > 0; }
+    size_t bufferedBytes() const { return buffer_.size(); }
+
+    // 取出所有完整事件, 未完成的事件留在缓冲中
+    std::string takeCompleteEvents();
+    // 流结束或缓冲超限时取出全部数据
+    std::string takeAll();
+
+private:
+    std::string buffer_;
+    size_t completeEnd_ = 0;     // [0, completeEnd_) 为完整事件
+    size_t scanFrom_ = 0;
+    bool atLineStart_ = false;
 };
 
 // WebSocket连接信息
@@ -76,23 +395,139 @@ struct ClientInfo {
 };
 
 // 事件回调类型
-using ConnectionCallback = std::function<void(websocketpp::connection_hdl::type)>;
+using ConnectionCallback = std::function<void(websocketpp::connection_hdl)>;
 using MessageCallback = std::function<void(const std::string&)>;
+using MessageSender = std::function<void(websocketpp::connection_hdl, const std::string&)>;
+
+// 代理请求的处理阶段
+enum class TraceStage : uint8_t {
+    Accept,
+    BuildProxyRequest,
+    WebSocketSend,
+    ResponseHeaders,
+    Chunk,
+    StreamEnd,
+    ResponseComplete
+};
+
+const char* traceStageName(TraceStage stage);
+
+struct TraceEvent {
+    uint64_t timestampNs = 0;
+    uint32_t threadId = 0;
+    TraceStage stage = TraceStage::Accept;
+    char requestId[32] = {};
+};
+
+// 请求追踪器：按请求ID采样, 每个线程写自己的定长环形缓冲, 按需导出 Chrome trace JSON
+class RequestTracer {
+public:
+    // sampleEvery 为 N 时约每 N 个请求追踪一个, 0 表示关闭
+    explicit RequestTracer(uint32_t sampleEvery = 64, size_t ringCapacity = 4096);
+
+    bool enabled() const { return sampleEvery_.load(std::memory_order_relaxed) != 0; }
+    // 采样只依赖请求ID, 任何线程都能独立得出同样的结论
+    bool sampled(const std::string& requestId) const;
+    void record(const std::string& requestId, TraceStage stage);
+    void record(const std::string& requestId, TraceStage stage, uint64_t timestampNs);
+
+    void setSampleEvery(uint32_t sampleEvery) { sampleEvery_.store(sampleEvery, std::memory_order_relaxed); }
+    std::string dumpChromeTrace() const;
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};   // 奇数表示正在写入
+        TraceEvent event;
+    };
+
+    struct ThreadRing {
+        explicit ThreadRing(size_t capacity, uint32_t id) : slots(capacity), threadId(id) {}
+        std::vector<Slot> slots;
+        uint64_t head = 0;                    // 仅所属线程修改
+        uint32_t threadId;
+    };
+
+    std::atomic<uint32_t> sampleEvery_;
+    size_t ringCapacity_;
+    uint64_t tracerId_;
+
+    mutable std::mutex ringsMutex_;
+    std::vector<std::shared_ptr<ThreadRing>> rings_;
+
+    ThreadRing& localRing();
+    void writeEvent(const std::string& requestId, TraceStage stage, uint64_t timestampNs);
+};
+
+// 流量录制文件布局 (dark-replay 回放):
+//   TrafficRecordFileHeader, 之后是紧密排列的记录序列
+//   记录 = TrafficRecordHeader + 负载 (proxy_request 的 JSON 或浏览器发回的原始帧)
+constexpr char kTrafficRecordMagic[8] = {'D', 'S', 'R', 'E', 'C', '0', '1', '\0'};
+
+struct TrafficRecordFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t startSystemNs;    // 开始录制时的 system_clock
+};
+
+enum class TrafficRecordKind : uint8_t { ProxyRequest = 1, BrowserEvent = 2 };
+
+struct TrafficRecordHeader {
+    uint32_t payloadSize;
+    uint8_t kind;
+    uint8_t reserved[3];
+    uint64_t offsetNs;         // 距开始录制的 steady_clock 纳秒
+};
+
+// 流量录制器：把转发的请求和浏览器事件按到达顺序追加写入文件
+class TrafficRecorder {
+public:
+    explicit TrafficRecorder(const std::string& path);
+    ~TrafficRecorder();
+
+    bool isOpen() const { return file_ != nullptr; }
+    void record(TrafficRecordKind kind, const std::string& payload);
+    uint64_t recordCount() const { return count_.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mutex_;
+    FILE* file_ = nullptr;
+    uint64_t startNs_ = 0;
+    std::atomic<uint64_t> count_{0};
+};
 
 // WebSocket连接管理器
 class ConnectionRegistry {
 public:
-    explicit ConnectionRegistry(std::shared_ptr<LoggingService> logger);
+    explicit ConnectionRegistry(std::shared_ptr<LoggingService> logger,
+                                std::shared_ptr<RequestTracer> tracer = nullptr);
     ~ConnectionRegistry();
     
-    void addConnection(websocketpp::connection_hdl::type hdl, const ClientInfo& clientInfo);
-    void removeConnection(websocketpp::connection_hdl::type hdl);
+    void addConnection(websocketpp::connection_hdl hdl, const ClientInfo& clientInfo);
+    void removeConnection(websocketpp::connection_hdl hdl);
     void handleIncomingMessage(const std::string& messageData);
+    // 接管整个帧的所有权, 无转义的 data 字段直接引用帧内存
+    void handleIncomingMessage(std::shared_ptr<std::string> frame);
+
+    PayloadCopyStats& copyStats() { return copyStats_; }
+    const FrameParseStats& parseStats() const { return parseStats_; }
+    void setTrafficRecorder(std::shared_ptr<TrafficRecorder> recorder);
+
+    // 事件分发表: 按驻留后的编号直接索引处理器
+    using EventHandler = std::function<void(Message&& message, const std::shared_ptr<MessageQueue>& queue)>;
+    static constexpr size_t kMaxEventTypes = 32;
+
+    // 注册或替换某个事件名称的处理器, 返回其编号; 需在开始接收浏览器消息之前调用
+    EventType registerEventHandler(const std::string& name, EventHandler handler);
+    EventType internEventType(std::string_view name) const;
     
     bool hasActiveConnections() const;
-    websocketpp::connection_hdl::type getFirstConnection() const;
+    websocketpp::connection_hdl getFirstConnection() const;
     
-    std::shared_ptr<MessageQueue> createMessageQueue(const std::string& requestId);
+    // maxQueues 为 0 表示不限制; 超过上限时返回 nullptr
+    std::shared_ptr<MessageQueue> createMessageQueue(const std::string& requestId,
+                                                     std::chrono::milliseconds timeout = std::chrono::milliseconds(600000),
+                                                     size_t maxQueues = 0);
     void removeMessageQueue(const std::string& requestId);
     
     // 事件回调设置
@@ -101,69 +536,545 @@ public:
 
 private:
     std::shared_ptr<LoggingService> logger_;
+    std::shared_ptr<RequestTracer> tracer_;
     mutable std::mutex connectionsMutex_;
-    std::set<websocketpp::connection_hdl::type, std::owner_less<websocketpp::connection_hdl::type>> connections_;
+    std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> connections_;
+    mutable std::mutex queuesMutex_;
     std::map<std::string, std::shared_ptr<MessageQueue>> messageQueues_;
     
     std::vector<ConnectionCallback> connectionAddedCallbacks_;
     std::vector<ConnectionCallback> connectionRemovedCallbacks_;
+    PayloadCopyStats copyStats_;
+    FrameParseStats parseStats_;
+    LogThrottle parseErrorLog_;
+    LogThrottle routingLog_;
+    std::shared_ptr<TrafficRecorder> recorder_;
+    std::array<std::string, kMaxEventTypes> eventNames_;
+    std::array<EventHandler, kMaxEventTypes> eventHandlers_;
+    size_t eventTypeCount_ = static_cast<size_t>(EventType::FirstCustom);
     
-    void routeMessage(const Message& message, std::shared_ptr<MessageQueue> queue);
+    void registerBuiltinEventHandlers();
+    // 解析整个帧, 不抛异常; data 字段原地反转义, 返回 [dataOffset, dataOffset + dataLength)
+    FrameError parseFrame(std::string& frame, Message& msg, size_t& dataOffset, size_t& dataLength,
+                          std::string& eventName);
+    void rejectFrame(FrameError error, const std::string& detail);
+    void routeMessage(Message&& message, std::shared_ptr<MessageQueue> queue);
+};
+
+// 令牌桶限流器：按客户端地址或指定请求头分桶
+// 桶表分片且无锁, 令牌在访问时按经过的时间惰性补充, 不需要后台线程
+class RateLimiter {
+public:
+    RateLimiter(double ratePerSecond, double burst, std::string keyHeader = "",
+                size_t shardCount = 64, size_t bucketsPerShard = 1024);
+
+    bool enabled() const { return ratePerSecond_.load(std::memory_order_relaxed) > 0; }
+    // 放行返回 true; 拒绝时 retryAfterMs 为下一个令牌到达前的等待时间
+    bool allow(std::string_view key, uint64_t* retryAfterMs = nullptr);
+    bool allowRequest(const httplib::Request& req, uint64_t* retryAfterMs = nullptr);
+    void setLimits(double ratePerSecond, double burst);
+
+    uint64_t overflowCount() const { return overflow_.load(std::memory_order_relaxed); }
+
+private:
+    // state 高40位为上次补充时间(毫秒), 低24位为千分之一令牌数
+    static constexpr int kTokenBits = 24;
+    static constexpr uint64_t kTokenMask = (uint64_t{1} << kTokenBits) - 1;
+    static constexpr uint64_t kMilliPerToken = 1000;
+    static constexpr size_t kMaxProbe = 8;
+
+    struct alignas(16) Bucket {
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint64_t> state{0};      // 0 表示新桶(满令牌)
+    };
+
+    struct alignas(64) Shard {
+        std::unique_ptr<Bucket[]> buckets;
+    };
+
+    std::atomic<double> ratePerSecond_;
+    std::atomic<uint64_t> burstMilli_;
+    std::string keyHeader_;
+    size_t shardMask_;
+    size_t bucketMask_;
+    std::unique_ptr<Shard[]> shards_;
+    std::chrono::steady_clock::time_point epoch_;
+    std::atomic<uint64_t> overflow_{0};
+
+    Bucket* findBucket(uint64_t hash, uint64_t nowMs, double rate, uint64_t burstMilli);
+};
+
+// 无锁多生产者单消费者队列 (Vyukov 链表队列), 只有持有消费权的线程可以调用 pop/empty
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head_(&stub_), tail_(&stub_) {}
+    ~MpscQueue() {
+        T value;
+        while (pop(value)) {}
+        if (tail_ != &stub_) delete tail_;
+    }
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T value) {
+        Node* node = new Node{std::move(value), {nullptr}};
+        Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    bool pop(T& out) {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) return false;
+        out = std::move(next->value);
+        tail_ = next;
+        if (tail != &stub_) delete tail;
+        return true;
+    }
+
+    // 生产者刚交换完 head_ 还未链接时可能短暂返回 true
+    bool empty() const { return tail_->next.load(std::memory_order_seq_cst) == nullptr; }
+
+private:
+    struct Node {
+        T value;
+        std::atomic<Node*> next;
+    };
+
+    Node stub_{T(), {nullptr}};
+    std::atomic<Node*> head_;
+    Node* tail_;
+};
+
+// 优先级类别: 按路径前缀或请求头匹配, 按权重分享浏览器连接
+struct PriorityClassConfig {
+    std::string name;
+    uint32_t weight = 1;
+    std::string pathPrefix;
+    std::string header;
+    std::string headerValue;     // 为空时只要求请求头存在
+};
+
+// 请求调度器：每个浏览器连接限制同时进行的请求数, 超出的请求进入该连接按优先级划分的无锁队列,
+// 由赤字轮询 (DRR) 按权重出队, 交互类请求不会被批量请求饿死
+class RequestScheduler {
+public:
+    using Dispatch = std::function<void(websocketpp::connection_hdl)>;
+
+    struct Lane;
+
+    // 一个请求的调度状态, 由 processRequest 持有, 完成时交回调度器
+    struct Ticket {
+        enum State : int { Queued = 0, Dispatched = 1, Finished = 2, Cancelled = 3 };
+        std::atomic<int> state{Queued};
+        std::weak_ptr<Lane> lane;      // 连接断开后 Lane 随之释放
+        Dispatch dispatch;
+    };
+
+    struct Lane {
+        explicit Lane(websocketpp::connection_hdl hdl, size_t classCount);
+
+        websocketpp::connection_hdl hdl;
+        std::atomic<uint32_t> inflight{0};
+        std::atomic<uint32_t> queued{0};
+        std::atomic<bool> draining{false};
+        std::vector<std::unique_ptr<MpscQueue<std::shared_ptr<Ticket>>>> queues;
+        std::vector<uint32_t> deficits;        // 只由持有 draining 的线程访问
+        size_t cursor = 0;
+    };
+
+    RequestScheduler(std::shared_ptr<LoggingService> logger, std::vector<PriorityClassConfig> classes,
+                     uint32_t maxInflightPerConnection);
+
+    size_t classify(const httplib::Request& req) const;
+    const std::string& className(size_t priority) const { return classes_[priority].name; }
+
+    void addConnection(websocketpp::connection_hdl hdl);
+    void removeConnection(websocketpp::connection_hdl hdl);
+
+    // 选择负载最轻的连接排队, 没有连接时返回 nullptr
+    std::shared_ptr<Ticket> submit(size_t priority, Dispatch dispatch);
+    // 请求结束 (完成、超时或失败) 时调用, 释放连接上的名额或取消排队
+    void complete(const std::shared_ptr<Ticket>& ticket);
+
+private:
+    using LaneList = std::vector<std::shared_ptr<Lane>>;
+
+    std::shared_ptr<LoggingService> logger_;
+    std::vector<PriorityClassConfig> classes_;
+    size_t defaultClass_ = 0;
+    uint32_t maxInflight_;
+    std::mutex lanesWriteMutex_;
+    std::shared_ptr<const LaneList> lanes_;    // 写时复制, 读取用 std::atomic_load
+
+    void drain(Lane& lane);
+    bool drainOnce(Lane& lane);
+};
+
+class ConfigStore;
+
+// 请求截止时间: 取自请求头或路由默认值, 都没有时使用全局 requestTimeoutMs
+struct RequestDeadline {
+    std::chrono::steady_clock::time_point at;
+    int64_t unixMs = 0;              // 发给浏览器的绝对时间 (毫秒)
+    bool explicitLimit = false;      // SSE 长连接只受请求头或路由给出的截止时间约束
 };
 
 // 请求处理器
 class RequestHandler {
 public:
     RequestHandler(std::shared_ptr<ConnectionRegistry> connectionRegistry, 
-                   std::shared_ptr<LoggingService> logger);
+                   std::shared_ptr<LoggingService> logger,
+                   std::shared_ptr<RequestTracer> tracer = nullptr,
+                   std::shared_ptr<RateLimiter> rateLimiter = nullptr,
+                   std::shared_ptr<const ConfigStore> configStore = nullptr,
+                   std::shared_ptr<RequestScheduler> scheduler = nullptr);
     
     void processRequest(const httplib::Request& req, httplib::Response& res);
+    void setMessageSender(MessageSender sender);
+    void setTrafficRecorder(std::shared_ptr<TrafficRecorder> recorder);
 
 private:
     std::shared_ptr<ConnectionRegistry> connectionRegistry_;
     std::shared_ptr<LoggingService> logger_;
+    std::shared_ptr<RequestTracer> tracer_;
+    std::shared_ptr<RateLimiter> rateLimiter_;
+    std::shared_ptr<const ConfigStore> configStore_;
+    std::shared_ptr<RequestScheduler> scheduler_;
+    MessageSender messageSender_;
+    std::shared_ptr<TrafficRecorder> recorder_;
     
     std::string generateRequestId();
-    Message buildProxyRequest(const httplib::Request& req, const std::string& requestId);
-    void forwardRequest(const Message& proxyRequest);
-    void handleResponse(std::shared_ptr<MessageQueue> messageQueue, httplib::Response& res);
+    Message buildProxyRequest(const httplib::Request& req, const std::string& requestId,
+                              const RequestDeadline& deadline);
+    void forwardRequest(const Message& proxyRequest, websocketpp::connection_hdl connection);
+    // 经调度器排队转发, 调度器未启用时直接发往第一个连接
+    std::shared_ptr<RequestScheduler::Ticket> dispatchRequest(const httplib::Request& req, Message proxyRequest,
+                                                              std::shared_ptr<MessageQueue> messageQueue);
+    std::chrono::milliseconds requestTimeout() const;
+    RequestDeadline requestDeadline(const httplib::Request& req) const;
+    // 返回 true 表示响应改为流式输出, 消息队列由内容提供器在结束时释放
+    bool handleResponse(const httplib::Request& req, std::shared_ptr<MessageQueue> messageQueue,
+                        const std::string& requestId, const RequestDeadline& deadline, httplib::Response& res,
+                        std::shared_ptr<RequestScheduler::Ticket> ticket);
+    // 等待下一条消息, 期间定期检查客户端是否已断开; 超时返回 false, 客户端断开时抛出 "Client closed"
+    bool waitForMessage(const httplib::Request& req, MessageQueue& messageQueue, Message& message,
+                        std::chrono::steady_clock::time_point deadline);
     void setResponseHeaders(httplib::Response& res, const Message& headerMessage);
-    void streamResponseData(std::shared_ptr<MessageQueue> messageQueue, httplib::Response& res);
+    void streamResponseData(const httplib::Request& req, std::shared_ptr<MessageQueue> messageQueue,
+                            const std::string& requestId, const RequestDeadline& deadline, httplib::Response& res);
+    void streamServerSentEvents(std::shared_ptr<MessageQueue> messageQueue, const std::string& requestId,
+                                const RequestDeadline& deadline, const std::string& contentType,
+                                httplib::Response& res, std::shared_ptr<RequestScheduler::Ticket> ticket);
+    // 通知浏览器放弃请求 (截止时间已过或客户端已断开), 请求尚未转发时不发送
+    void cancelRequest(const std::string& requestId, MessageQueue& messageQueue, const char* reason);
+    void finishRequest(const std::string& requestId, const std::shared_ptr<RequestScheduler::Ticket>& ticket);
     void handleRequestError(const std::exception& error, httplib::Response& res);
     void sendErrorResponse(httplib::Response& res, int status, const std::string& message);
 };
 
+// 按路径前缀设置的默认请求超时
+struct RouteTimeoutConfig {
+    std::string pathPrefix;
+    int64_t timeoutMs = 0;
+};
+
 // 服务器配置
+// 端口、监听地址、线程数、二进制日志、追踪端点、限流键、录制文件、TLS、优先级调度和工作进程数需要重启生效, 其余字段可通过 SIGHUP 热加载
 struct ServerConfig {
     int httpPort = 8889;
     int wsPort = 9998;
     std::string host = "0.0.0.0";
+    int httpThreads = 8;
+
+    // 等待浏览器响应的超时时间
+    int64_t requestTimeoutMs = 600000;
+    // 按顺序匹配路径前缀, 第一个匹配的覆盖 requestTimeoutMs
+    std::vector<RouteTimeoutConfig> routeTimeouts;
+    // 客户端可用该请求头 (毫秒) 缩短超时, 不能超过路由或全局超时; 为空表示忽略
+    std::string requestTimeoutHeader = "X-Request-Timeout";
+    // 同时进行中的代理请求上限, 0 表示不限制
+    size_t maxConcurrentRequests = 0;
+    LogLevel logLevel = LogLevel::Info;
+
+    // text/event-stream 响应流式转发, 在该时间窗口(微秒)内到达的小块合并为一次写出
+    bool sseStreaming = true;
+    int64_t sseCoalesceWindowUs = 2000;
+    size_t sseMaxBufferedBytes = 64 * 1024;
+
+    // 使用 epoll 接入层代替 httplib 的阻塞线程模型 (仅 Linux)
+    bool epollFrontend = false;
+    int keepAliveTimeoutSec = 60;
+    size_t maxRequestBytes = 64 * 1024 * 1024;
+    size_t slabSize = 16 * 1024;
+
+    // 非空时启用二进制日志, 用 dark-log-decode 查看
+    std::string binaryLogPath;
+    size_t binaryLogCapacity = 64 * 1024 * 1024;
+
+    // 请求追踪: 每 traceSampleEvery 个请求采样一个, 0 表示关闭
+    uint32_t traceSampleEvery = 64;
+    size_t traceRingCapacity = 4096;
+    std::string traceEndpoint = "/__dark/trace";
+
+    // 限流: 每个客户端每秒令牌数, 0 表示关闭; 设置 rateLimitKeyHeader 时按该请求头分桶, 否则按远端地址
+    double rateLimitPerSecond = 0;
+    double rateLimitBurst = 20;
+    std::string rateLimitKeyHeader;
+
+    // 非空时录制全部代理流量, 用 dark-replay 回放
+    std::string recordPath;
+
+    // TLS: 证书和私钥都设置时 HTTP 和 WebSocket 监听都改用 TLS, 需以 DARK_SERVER_TLS 编译
+    std::string tlsCertFile;     // PEM 证书链
+    std::string tlsKeyFile;      // PEM 私钥
+    bool tlsSessionTickets = true;
+    bool tlsKtls = true;         // 内核和 OpenSSL 支持时把记录加解密交给内核
+
+    // 优先级调度: 每个浏览器连接同时进行的请求上限, 0 表示不排队直接转发
+    // 请求按 priorityClasses 顺序匹配, 都不匹配时归入第一个没有匹配条件的类别
+    uint32_t maxInflightPerConnection = 0;
+    std::vector<PriorityClassConfig> priorityClasses;
+
+    // 多进程模式 (仅 Linux): 大于 1 时 fork 出对应数量的工作进程, 通过 SO_REUSEPORT 共享 HTTP 和 WebSocket 端口;
+    // 使用 epoll 前端时, 没有浏览器连接的进程把请求连接转交给拥有连接的进程, 超过 maxHandoffBytes 的请求不转交
+    int workerProcesses = 1;
+    size_t maxHandoffBytes = 64 * 1024;
 };
 
+// 从 JSON 文件读取配置, 文件中未出现的字段保持 config 中的值
+bool loadServerConfig(const std::string& path, ServerConfig& config, std::string& error);
+
+// 配置快照存储 (RCU 风格): 请求路径无锁读取当前快照, 重新加载时整体替换
+// 旧快照保留到进程退出, 读者拿到的引用始终有效
+class ConfigStore {
+public:
+    explicit ConfigStore(const ServerConfig& initial);
+
+    const ServerConfig& current() const { return *current_.load(std::memory_order_acquire); }
+    void publish(const ServerConfig& next);
+
+private:
+    std::atomic<const ServerConfig*> current_;
+    std::mutex writerMutex_;
+    std::vector<std::unique_ptr<const ServerConfig>> snapshots_;
+};
+
+using HttpHandler = std::function<void(const httplib::Request&, httplib::Response&)>;
+
+#ifdef __linux__
+// 把一个完整读取了请求的 HTTP 连接交给其他进程, 返回 true 表示已转交, 本进程只需关闭自己的描述符
+using HandoffHandler = std::function<bool(int fd, const char* buffered, size_t size)>;
+
+// 固定大小缓冲区的共享池, 连接只在有数据收发时占用缓冲区
+class SlabPool {
+public:
+    SlabPool(size_t slabSize, size_t maxCached);
+    ~SlabPool();
+
+    char* acquire();
+    void release(char* slab);
+    size_t slabSize() const { return slabSize_; }
+
+private:
+    size_t slabSize_;
+    size_t maxCached_;
+    std::mutex mutex_;
+    std::vector<char*> free_;
+};
+
+// 基于 epoll 边沿触发的 HTTP 接入层
+// 空闲的 keep-alive 连接只占一个小状态结构, 不占线程和缓冲区;
+// 请求读取完整后交给工作线程执行 handler, 处理完再交回事件循环重新挂起
+class EpollHttpFrontend {
+public:
+    EpollHttpFrontend(HttpHandler handler, std::shared_ptr<LoggingService> logger, const ServerConfig& config);
+    ~EpollHttpFrontend();
+
+    bool start(const std::string& host, int port);
+    void stop();
+    size_t connectionCount() const { return connectionCount_.load(std::memory_order_relaxed); }
+
+    // 需在 start 之前设置
+    void setHandoff(HandoffHandler handoff) { handoff_ = std::move(handoff); }
+    // 接管其他进程转交的连接, buffered 为对方已读取的字节; 可在任意线程调用
+    void adoptConnection(int fd, std::string buffered);
+
+private:
+    struct Connection {
+        int fd = -1;
+        bool busy = false;                 // 已交给工作线程, 仅事件循环线程读写
+        bool closeAfterResponse = false;   // 仅工作线程在持有连接时写
+        std::atomic<bool> peerClosed{false};   // 处理期间事件循环观察到对端关闭
+        bool adopted = false;              // 由其他进程转交而来, 不再继续转交
+        uint8_t family = 0;
+        uint16_t remotePort = 0;
+        uint8_t remoteAddr[16] = {};
+        uint32_t used = 0;                 // 已缓冲的字节数
+        uint32_t expected = 0;             // 已知的完整请求长度, 0 表示头部尚未读完
+        uint32_t lastActiveSec = 0;
+        char* buffer = nullptr;            // 来自 SlabPool, 空闲时为 nullptr
+        std::unique_ptr<std::string> overflow;   // 超过一个 slab 的大请求
+
+        char* data() { return overflow ? &(*overflow)[0] : buffer; }
+    };
+
+    HttpHandler handler_;
+    std::shared_ptr<LoggingService> logger_;
+    size_t maxRequestBytes_;
+    uint32_t keepAliveTimeoutSec_;
+    size_t workerCount_;
+    bool reusePort_;
+    SlabPool slabPool_;
+    HandoffHandler handoff_;
+
+    int listenFd_ = -1;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    std::atomic<bool> running_{false};
+    std::atomic<size_t> connectionCount_{0};
+    std::thread loopThread_;
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<Connection>> connections_;   // 以 fd 为下标, 仅事件循环线程访问
+
+    std::mutex tasksMutex_;
+    std::condition_variable tasksCv_;
+    std::queue<Connection*> tasks_;
+
+    std::mutex completedMutex_;
+    std::vector<Connection*> completed_;
+    std::vector<std::pair<int, std::string>> adopted_;
+
+    void runLoop();
+    void acceptConnections();
+    void handleReadable(Connection* conn);
+    void handleCompleted();
+    void handleAdopted();
+    void registerConnection(std::unique_ptr<Connection> conn, uint32_t events);
+    void sweepIdle();
+    void dispatch(Connection* conn);
+    void rearm(Connection* conn);
+    void watchHangup(Connection* conn);
+    void closeConnection(Connection* conn);
+    void releaseBufferIfIdle(Connection* conn);
+    void workerLoop();
+    void serve(Connection* conn);
+    int readRequestHead(Connection* conn);
+    bool writeResponse(Connection* conn, const httplib::Request& req, httplib::Response& res, bool keepAlive);
+};
+
+// 多进程模式的浏览器连接目录: fork 之前映射的匿名共享内存, 记录每个浏览器连接属于哪个工作进程
+class WorkerDirectory {
+public:
+    static constexpr size_t kMaxWorkers = 64;
+    static constexpr size_t kMaxConnections = 4096;
+
+    explicit WorkerDirectory(size_t workerCount);
+    ~WorkerDirectory();
+    WorkerDirectory(const WorkerDirectory&) = delete;
+    WorkerDirectory& operator=(const WorkerDirectory&) = delete;
+
+    size_t workerCount() const { return workerCount_; }
+    // 登记一个浏览器连接, 返回槽位; 目录已满时返回 -1, 连接照常使用, 只是其他进程看不到
+    int addConnection(size_t worker);
+    void removeConnection(size_t worker, int slot);
+    // 工作进程退出后由主进程清除它的全部登记
+    void clearWorker(size_t worker);
+    size_t connectionCount(size_t worker) const;
+    // 轮询选出另一个拥有浏览器连接的工作进程, 没有时返回 -1
+    int pickOwner(size_t self);
+
+private:
+    struct Shared {
+        std::atomic<uint32_t> cursor;
+        std::atomic<uint32_t> counts[kMaxWorkers];
+        std::atomic<uint32_t> owners[kMaxConnections];   // 工作进程编号 + 1, 0 表示空闲
+    };
+
+    size_t workerCount_;
+    Shared* shared_ = nullptr;
+};
+
+// 工作进程之间转交 HTTP 连接: 抽象命名空间的 Unix 数据报套接字,
+// 描述符经 SCM_RIGHTS 传递, 数据报正文为转出方已读取的请求字节
+class ConnectionHandoff {
+public:
+    using Receiver = std::function<void(int fd, std::string buffered)>;
+
+    ConnectionHandoff(std::string name, size_t worker, size_t maxBytes, std::shared_ptr<LoggingService> logger);
+    ~ConnectionHandoff();
+
+    bool start(Receiver receiver);
+    void stop();
+    bool send(size_t worker, int fd, const char* data, size_t size);
+
+private:
+    std::string name_;
+    size_t worker_;
+    size_t maxBytes_;
+    std::shared_ptr<LoggingService> logger_;
+    int recvFd_ = -1;
+    int sendFd_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+
+    void receiveLoop(Receiver receiver);
+};
+
+// 多进程模式: 主进程创建共享目录后 fork 出 workerProcesses 个工作进程并负责转发信号和重启
+void runWorkerProcesses(const ServerConfig& config, const std::string& configPath);
+#endif
+
 // 主服务器类
 class ProxyServerSystem {
 public:
-    explicit ProxyServerSystem(const ServerConfig& config = ServerConfig{});
+    explicit ProxyServerSystem(const ServerConfig& config = ServerConfig{}, const std::string& configPath = "");
     ~ProxyServerSystem();
     
     void start();
     void stop();
+    // 重新读取配置文件并应用可热加载的字段, 收到 SIGHUP 时自动调用
+    void reloadConfig();
     
     // 事件回调
     void onStarted(std::function<void()> callback);
     void onError(std::function<void(const std::string&)> callback);
 
+#ifdef __linux__
+    // 多进程模式下在 start 之前调用: 登记本进程的浏览器连接, 并接收其他进程转交的 HTTP 连接
+    void setWorker(size_t index, std::shared_ptr<WorkerDirectory> directory, const std::string& handoffName);
+#endif
+
 private:
     ServerConfig config_;
+    std::string configPath_;
+    std::shared_ptr<ConfigStore> configStore_;
     std::shared_ptr<LoggingService> logger_;
+    std::shared_ptr<RequestTracer> tracer_;
+    std::shared_ptr<RateLimiter> rateLimiter_;
+    std::shared_ptr<TrafficRecorder> recorder_;
+    std::shared_ptr<RequestScheduler> scheduler_;
     std::shared_ptr<ConnectionRegistry> connectionRegistry_;
     std::shared_ptr<RequestHandler> requestHandler_;
     
     std::unique_ptr<httplib::Server> httpServer_;
-    std::unique_ptr<websocketpp::server<websocketpp::config::asio::server>> wsServer_;
+#ifdef __linux__
+    std::unique_ptr<EpollHttpFrontend> epollFrontend_;
+    size_t workerIndex_ = 0;
+    std::shared_ptr<WorkerDirectory> workerDirectory_;
+    std::unique_ptr<ConnectionHandoff> handoff_;
+    std::mutex directorySlotsMutex_;
+    std::map<websocketpp::connection_hdl, int, std::owner_less<websocketpp::connection_hdl>> directorySlots_;
+#endif
+    std::unique_ptr<websocketpp::server<websocketpp::config::asio>> wsServer_;
+#ifdef DARK_SERVER_TLS
+    std::unique_ptr<websocketpp::server<websocketpp::config::asio_tls>> wssServer_;
+#endif
     
     std::thread httpThread_;
     std::thread wsThread_;
+    std::thread reloadThread_;
     std::atomic<bool> running_{false};
     
     std::vector<std::function<void()>> startedCallbacks_;
@@ -172,10 +1083,20 @@ private:
     void startHttpServer();
     void startWebSocketServer();
     void setupHttpRoutes();
-    void setupWebSocketHandlers();
+    void routeHttpRequest(const httplib::Request& req, httplib::Response& res);
+    template <typename WSServer>
+    void setupWebSocketHandlers(WSServer& server);
+    template <typename WSServer>
+    void runWebSocketServer(WSServer& server, const char* scheme);
+    bool tlsEnabled() const { return !config_.tlsCertFile.empty() && !config_.tlsKeyFile.empty(); }
+    void applyRuntimeConfig(const ServerConfig& config);
+#ifdef __linux__
+    bool handOffConnection(int fd, const char* buffered, size_t size);
+#endif
+    void watchReloadSignal();
 };
 
 // 初始化函数
-void initializeServer();
+void initializeServer(const std::string& configPath = "");
 
 } // namespace DarkServer
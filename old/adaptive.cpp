@@ -0,0 +1,98 @@
+// adaptive.cpp
+#pragma once
+#include "adaptive.h"
+
+adaptive_engine::adaptive_engine(size_t count, const adaptive_config &config) : config(config)
+{
+    for (int op = 0; op < 4; op++)
+    {
+        initial.latency[op] = static_cast<uint16_t>(config.target_ms < 65535 ? config.target_ms : 65535);
+        initial.accuracy[op] = 49152;
+    }
+    initial.skill = config.start_skill;
+    initial.answers = 0;
+    initial.reserved = 0;
+    learners.assign(count, initial);
+}
+
+void adaptive_engine::resize(size_t count)
+{
+    learners.resize(count, initial);
+}
+
+size_t adaptive_engine::size() const
+{
+    return learners.size();
+}
+
+// x += (sample - x) / 2^shift in integers
+static inline uint16_t ewma(uint16_t x, uint32_t sample, int shift)
+{
+    int32_t delta = static_cast<int32_t>(sample) - x;
+    return static_cast<uint16_t>(x + (delta >> shift));
+}
+
+void adaptive_engine::record(size_t learner, int ops, uint32_t latency_ms, bool correct)
+{
+    learner_state &s = learners[learner];
+    uint32_t latency = latency_ms < 65535 ? latency_ms : 65535;
+    uint32_t hit = correct ? 65535 : 0;
+    for (int op = 0; op < 4; op++)
+    {
+        if (ops & (1 << op))
+        {
+            s.latency[op] = ewma(s.latency[op], latency, config.ewma_shift);
+            s.accuracy[op] = ewma(s.accuracy[op], hit, config.ewma_shift);
+        }
+    }
+
+    // A staircase: up after a quick correct answer, down after a wrong one,
+    // unchanged after a slow correct one
+    int32_t skill = s.skill;
+    if (!correct)
+        skill -= config.skill_down;
+    else if (latency_ms <= config.target_ms)
+        skill += config.skill_up;
+    s.skill = static_cast<uint16_t>(skill < 0 ? 0 : skill > 65535 ? 65535 : skill);
+    if (s.answers != UINT16_MAX)
+        s.answers++;
+}
+
+double adaptive_engine::difficulty(size_t learner) const
+{
+    return 1.0 + learners[learner].skill * 4.0 / 65535;
+}
+
+// Between two levels of get_difficulty_params, current_chance and max_value
+// move linearly. An operator gets more weight the less accurate and the
+// slower the learner is with it, so weak spots come up more often.
+void adaptive_engine::configure(size_t learner, generator_context &ctx) const
+{
+    const learner_state &s = learners[learner];
+    uint32_t scaled = s.skill * 4u; // level - 1 in 1/65535 units
+    int level = static_cast<int>(scaled / 65535) + 1;
+    uint32_t fraction = scaled % 65535;
+    int chance_lo, value_lo, chance_hi, value_hi;
+    get_difficulty_params(level, chance_lo, value_lo);
+    get_difficulty_params(level < 5 ? level + 1 : 5, chance_hi, value_hi);
+    ctx.current_chance = chance_lo + static_cast<int>((chance_hi - chance_lo) * static_cast<int64_t>(fraction) / 65535);
+    ctx.max_value = value_lo + static_cast<int>((value_hi - value_lo) * static_cast<int64_t>(fraction) / 65535);
+    ctx.child_max = fraction < 32768 ? level : (level < 5 ? level + 1 : 5);
+
+    for (int op = 0; op < 4; op++)
+    {
+        uint32_t miss = (65535u - s.accuracy[op]) >> 10;  // 0 to 63
+        uint32_t slow = s.latency[op] > config.target_ms ? 16 : 0;
+        ctx.op_weights[op] = static_cast<uint16_t>(16 + miss + slow);
+    }
+}
+
+learner_state &adaptive_engine::operator[](size_t learner)
+{
+    return learners[learner];
+}
+
+const learner_state &adaptive_engine::operator[](size_t learner) const
+{
+    return learners[learner];
+}
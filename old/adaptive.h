@@ -0,0 +1,59 @@
+//adaptive.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "caculator.h"
+#include "generator_context.h"
+
+// Per-learner answer statistics, 24 bytes so that millions of sessions fit
+// in one flat array. Operators are indexed like "+-*/".
+struct learner_state
+{
+    uint16_t latency[4];  // EWMA of the answer time per operator, ms
+    uint16_t accuracy[4]; // EWMA of correct answers per operator, 65535 = all
+    uint16_t skill;       // difficulty 1 to 5 mapped onto 0 to 65535
+    uint16_t answers;     // answers seen, saturating
+    uint32_t reserved;
+};
+static_assert(sizeof(learner_state) == 24, "learner_state is stored in bulk");
+
+struct adaptive_config
+{
+    uint32_t target_ms = 10000;  // answer time of a comfortable problem, cf. towait
+    int ewma_shift = 3;          // each answer weighs 1/8
+    // Skill settles where up * P(quick and correct) = down * P(wrong):
+    // about 2/3 correct with these steps
+    uint16_t skill_up = 1024;    // correct within target_ms: +1/16 of a level
+    uint16_t skill_down = 2048;  // wrong: -1/8 of a level
+    uint16_t start_skill = 32768; // difficulty 3
+};
+
+// Maps answers to generator parameters. record() is a handful of integer
+// operations on one learner_state; different learners may be recorded from
+// different threads, one learner only from one thread at a time.
+class adaptive_engine
+{
+public:
+    explicit adaptive_engine(size_t learners = 0, const adaptive_config &config = adaptive_config());
+    void resize(size_t learners);
+    size_t size() const;
+
+    // ops: operator mask of the problem answered, see operator_mask()
+    void record(size_t learner, int ops, uint32_t latency_ms, bool correct);
+    // Sets current_chance, max_value, child_max and op_weights of ctx
+    void configure(size_t learner, generator_context &ctx) const;
+    // Difficulty 1.0 to 5.0
+    double difficulty(size_t learner) const;
+
+    learner_state &operator[](size_t learner);
+    const learner_state &operator[](size_t learner) const;
+
+private:
+    adaptive_config config;
+    std::vector<learner_state> learners;
+    learner_state initial;
+};
+
+#include "adaptive.cpp"
@@ -0,0 +1,245 @@
+// answer_parser.cpp
+#pragma once
+#include "answer_parser.h"
+
+// Recursive descent over [p, end); depth bounds the recursion on input
+// such as "((((" so the stack use is fixed
+struct answer_parser
+{
+    const char *p;
+    const char *end;
+    int depth;
+    parse_status status;
+
+    void skip_spaces()
+    {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            p++;
+    }
+
+    bool fail(parse_status s)
+    {
+        if (status == parse_status::ok)
+            status = s;
+        return false;
+    }
+
+    // Integers stay on checked int64; anything with a denominator goes
+    // through exact_apply
+    bool apply(char op, const exact_value &a, const exact_value &b, exact_value &out)
+    {
+        if (op == '/' && b.num == 0)
+            return fail(parse_status::division_by_zero);
+        bool fits;
+        if (a.den == 1 && b.den == 1 && op != '/')
+        {
+            out.den = 1;
+            out.status = eval_status::ok;
+            if (op == '+')
+                fits = checked_add(a.num, b.num, out.num);
+            else if (op == '-')
+                fits = checked_sub(a.num, b.num, out.num);
+            else
+                fits = checked_mul(a.num, b.num, out.num);
+        }
+        else
+        {
+            fits = exact_apply(op, a, b, out) == eval_status::ok;
+        }
+        return fits ? true : fail(parse_status::overflow);
+    }
+
+    bool number(exact_value &out)
+    {
+        const char *start = p;
+        int64_t num = 0, den = 1;
+        while (p != end && *p >= '0' && *p <= '9')
+        {
+            if (!checked_mul(num, 10, num) || !checked_add(num, *p++ - '0', num))
+                return fail(parse_status::overflow);
+        }
+        if (p != end && *p == '.')
+        {
+            p++;
+            while (p != end && *p >= '0' && *p <= '9')
+            {
+                if (!checked_mul(num, 10, num) || !checked_add(num, *p++ - '0', num) || !checked_mul(den, 10, den))
+                    return fail(parse_status::overflow);
+            }
+        }
+        if (p == start || (p - start == 1 && *start == '.'))
+            return fail(parse_status::syntax_error);
+        // den is a power of ten, so 2 and 5 are its only factors
+        while (den % 2 == 0 && num % 2 == 0)
+        {
+            num /= 2;
+            den /= 2;
+        }
+        while (den % 5 == 0 && num % 5 == 0)
+        {
+            num /= 5;
+            den /= 5;
+        }
+        out.num = num;
+        out.den = den;
+        out.status = eval_status::ok;
+        return true;
+    }
+
+    // [sign] number [/ number]: a value written out, never a calculation
+    bool literal(exact_value &out)
+    {
+        skip_spaces();
+        bool negate = p != end && *p == '-';
+        if (p != end && (*p == '-' || *p == '+'))
+            p++;
+        if (!number(out))
+            return false;
+        if (negate)
+            out.num = -out.num;
+        skip_spaces();
+        if (p != end && *p == '/')
+        {
+            p++;
+            skip_spaces();
+            // Only a fraction in lowest terms of two integers: "164/2" would
+            // let the question 164/2 be typed back as its own answer
+            exact_value divisor;
+            int64_t numerator = out.num;
+            if (!number(divisor))
+                return false;
+            if (out.den != 1 || divisor.den != 1 || divisor.num < 2)
+                return fail(parse_status::syntax_error);
+            if (!apply('/', out, divisor, out))
+                return false;
+            if (out.den != divisor.num || out.num != numerator)
+                return fail(parse_status::syntax_error);
+        }
+        return true;
+    }
+
+    bool unary(exact_value &out)
+    {
+        if (++depth > max_parse_depth)
+            return fail(parse_status::too_deep);
+        skip_spaces();
+        bool ok;
+        if (p == end)
+        {
+            ok = fail(parse_status::syntax_error);
+        }
+        else if (*p == '-' || *p == '+')
+        {
+            bool negate = *p++ == '-';
+            ok = unary(out);
+            if (ok && negate)
+            {
+                if (out.num == INT64_MIN)
+                    ok = fail(parse_status::overflow);
+                else
+                    out.num = -out.num;
+            }
+        }
+        else if (*p == '(')
+        {
+            p++;
+            ok = sum(out);
+            skip_spaces();
+            if (ok && (p == end || *p++ != ')'))
+                ok = fail(parse_status::syntax_error);
+        }
+        else
+        {
+            ok = number(out);
+        }
+        depth--;
+        return ok;
+    }
+
+    bool product(exact_value &out)
+    {
+        if (!unary(out))
+            return false;
+        while (true)
+        {
+            skip_spaces();
+            if (p == end || (*p != '*' && *p != '/'))
+                return true;
+            char op = *p++;
+            exact_value right;
+            if (!unary(right) || !apply(op, out, right, out))
+                return false;
+        }
+    }
+
+    bool sum(exact_value &out)
+    {
+        if (!product(out))
+            return false;
+        while (true)
+        {
+            skip_spaces();
+            if (p == end || (*p != '+' && *p != '-'))
+                return true;
+            char op = *p++;
+            exact_value right;
+            if (!product(right) || !apply(op, out, right, out))
+                return false;
+        }
+    }
+};
+
+parse_status parse_answer(std::string_view text, exact_value &out)
+{
+    answer_parser parser{text.data(), text.data() + text.size(), 0, parse_status::ok};
+    if (parser.sum(out))
+    {
+        parser.skip_spaces();
+        if (parser.p != parser.end)
+            parser.fail(parse_status::syntax_error);
+    }
+    return parser.status;
+}
+
+parse_status parse_number(std::string_view text, exact_value &out)
+{
+    answer_parser parser{text.data(), text.data() + text.size(), 0, parse_status::ok};
+    if (parser.literal(out))
+    {
+        parser.skip_spaces();
+        if (parser.p != parser.end)
+            parser.fail(parse_status::syntax_error);
+    }
+    return parser.status;
+}
+
+answer_grade grade_answer(std::string_view text, int64_t expected)
+{
+    // The usual answer is a plain integer: no parser state needed
+    const char *p = text.data(), *end = p + text.size();
+    bool negative = p != end && *p == '-';
+    const char *digits = p + negative;
+    if (digits != end && end - digits <= 18)
+    {
+        int64_t value = 0;
+        const char *q = digits;
+        while (q != end && *q >= '0' && *q <= '9')
+            value = value * 10 + (*q++ - '0');
+        if (q == end)
+            return (negative ? -value : value) == expected ? answer_grade::correct : answer_grade::wrong;
+    }
+
+    exact_value value;
+    if (parse_number(text, value) != parse_status::ok)
+        return answer_grade::invalid;
+    return value.den == 1 && value.num == expected ? answer_grade::correct : answer_grade::wrong;
+}
+
+void grade_answers(const problem_set &set, const uint32_t *problems, const std::string_view *answers, size_t count,
+                   answer_grade *out)
+{
+    for (size_t k = 0; k < count; k++)
+    {
+        out[k] = grade_answer(answers[k], set.get_result(problems[k]));
+    }
+}
@@ -0,0 +1,46 @@
+//answer_parser.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "exact_eval.h"
+#include "problem_set.h"
+
+enum class parse_status : uint8_t
+{
+    ok,
+    syntax_error,
+    too_deep, // more than max_parse_depth nested parentheses or signs
+    overflow,
+    division_by_zero
+};
+
+const int max_parse_depth = 64;
+
+// Parses and evaluates an answer: numbers, + - * /, parentheses, unary
+// signs and spaces, with the priorities of getOperatorPriority ('*' and '/'
+// before '+' and '-', left to right). Numbers may have a fractional part,
+// "2.5" is 5/2. Exact over 64-bit rationals, no allocation; the whole of
+// text must parse.
+parse_status parse_answer(std::string_view text, exact_value &out);
+// A written-out value only: an optional sign and a number, or a fraction
+// of integers in lowest terms, e.g. "-12", "2.5", "7/2". Any other
+// operator, or "164/2", is a syntax error, so an answer cannot be the
+// question typed back.
+parse_status parse_number(std::string_view text, exact_value &out);
+
+enum class answer_grade : uint8_t
+{
+    correct,
+    wrong,
+    invalid // not a number (see parse_number), or overflow / division by zero
+};
+
+// Grades a submitted value; expressions such as "37+45" are invalid
+answer_grade grade_answer(std::string_view text, int64_t expected);
+// out[k] grades answers[k] against problem problems[k] of set
+void grade_answers(const problem_set &set, const uint32_t *problems, const std::string_view *answers, size_t count,
+                   answer_grade *out);
+
+#include "answer_parser.cpp"
@@ -0,0 +1,161 @@
+// batch_eval.cpp
+#pragma once
+#include "batch_eval.h"
+#include <algorithm>
+#include <cstring>
+
+static void append_postfix(const expression_pool &pool, uint32_t index, std::string &code)
+{
+    const expression_node &node = pool[index];
+    if (node.op == 0)
+    {
+        code += 'v';
+        return;
+    }
+    append_postfix(pool, node.left, code);
+    append_postfix(pool, node.right, code);
+    code += node.op;
+}
+
+void compile_postfix(const expression_pool &pool, uint32_t root, std::string &code)
+{
+    code.clear();
+    append_postfix(pool, root, code);
+}
+
+uint32_t postfix_depth(const std::string &code)
+{
+    uint32_t depth = 0, max_depth = 0;
+    for (char c : code)
+    {
+        depth = c == 'v' ? depth + 1 : depth - 1;
+        max_depth = depth > max_depth ? depth : max_depth;
+    }
+    return max_depth;
+}
+
+// A problem of a problem_set is stored in preorder, so its operator bytes
+// identify its shape and its literals come in push order: one linear scan
+// of its nodes replaces walking the tree
+void batch_evaluator::compile(const problem_set &set)
+{
+    shape_index.clear();
+    groups.clear();
+    problem_count = set.size();
+    const expression_pool &pool = set.get_pool();
+    for (size_t i = 0; i < set.size(); i++)
+    {
+        uint32_t root = set.get_root(i), end = set.get_end(i);
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (uint32_t index = root; index < end; index++)
+            hash = (hash ^ static_cast<uint8_t>(pool[index].op)) * 0x100000001b3ULL;
+
+        shape_group *group = nullptr;
+        auto range = shape_index.equal_range(hash);
+        for (auto it = range.first; it != range.second && !group; ++it)
+        {
+            shape_group &candidate = groups[it->second];
+            if (candidate.shape.size() != end - root)
+                continue;
+            bool same = true;
+            for (uint32_t index = root; index < end && same; index++)
+                same = candidate.shape[index - root] == pool[index].op;
+            if (same)
+                group = &candidate;
+        }
+        if (!group)
+        {
+            shape_index.emplace(hash, static_cast<uint32_t>(groups.size()));
+            groups.emplace_back();
+            group = &groups.back();
+            for (uint32_t index = root; index < end; index++)
+                group->shape += pool[index].op;
+            compile_postfix(pool, root, group->code);
+            group->literals = static_cast<uint32_t>((group->code.size() + 1) / 2);
+            group->depth = postfix_depth(group->code);
+        }
+
+        size_t count = group->problems.size();
+        size_t lane = count % batch_lanes;
+        if (lane == 0)
+            group->operands.resize(group->operands.size() + group->literals * batch_lanes);
+        double *column = group->operands.data() + (count / batch_lanes) * group->literals * batch_lanes + lane;
+        for (uint32_t index = root; index < end; index++)
+        {
+            if (pool[index].op == 0)
+            {
+                *column = pool[index].value;
+                column += batch_lanes;
+            }
+        }
+        group->problems.push_back(static_cast<uint32_t>(i));
+    }
+}
+
+void batch_evaluator::run_block(const shape_group &group, size_t block, std::vector<double> &results)
+{
+    size_t first = block * batch_lanes;
+    size_t lanes = std::min(batch_lanes, group.problems.size() - first);
+    const double *in = group.operands.data() + block * group.literals * batch_lanes;
+
+    // Row sp - 1 of stack is the top of the stack
+    double *rows = stack.data();
+    size_t sp = 0;
+    for (char c : group.code)
+    {
+        if (c == 'v')
+        {
+            std::memcpy(rows + sp++ * batch_lanes, in, lanes * sizeof(double));
+            in += batch_lanes;
+            continue;
+        }
+        sp--;
+        double *a = rows + (sp - 1) * batch_lanes;
+        const double *b = rows + sp * batch_lanes;
+        switch (c)
+        {
+        case '+':
+            for (size_t lane = 0; lane < lanes; lane++)
+                a[lane] += b[lane];
+            break;
+        case '-':
+            for (size_t lane = 0; lane < lanes; lane++)
+                a[lane] -= b[lane];
+            break;
+        case '*':
+            for (size_t lane = 0; lane < lanes; lane++)
+                a[lane] *= b[lane];
+            break;
+        default:
+            for (size_t lane = 0; lane < lanes; lane++)
+                a[lane] /= b[lane];
+            break;
+        }
+    }
+    const uint32_t *problems = group.problems.data() + first;
+    for (size_t lane = 0; lane < lanes; lane++)
+        results[problems[lane]] = rows[lane];
+}
+
+void batch_evaluator::evaluate(std::vector<double> &results)
+{
+    results.resize(problem_count);
+    for (const auto &group : groups)
+    {
+        if (stack.size() < group.depth * batch_lanes)
+            stack.resize(group.depth * batch_lanes);
+        for (size_t block = 0; block * batch_lanes < group.problems.size(); block++)
+            run_block(group, block, results);
+    }
+}
+
+void batch_evaluator::evaluate(const problem_set &set, std::vector<double> &results)
+{
+    compile(set);
+    evaluate(results);
+}
+
+size_t batch_evaluator::shape_count() const
+{
+    return groups.size();
+}
@@ -0,0 +1,55 @@
+//batch_eval.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "problem_set.h"
+
+// Postfix form of a tree: 'v' pushes the next literal, '+' '-' '*' '/'
+// pop two values and push the result. Literals are listed in push order.
+// Two trees with the same code have the same shape.
+void compile_postfix(const expression_pool &pool, uint32_t root, std::string &code);
+uint32_t postfix_depth(const std::string &code);
+
+// Evaluates many problems at once. compile() groups the problems of a set
+// by shape, gives each group one postfix program and copies the literals
+// into a struct-of-arrays layout, [block][literal][lane] for blocks of
+// batch_lanes problems. evaluate() then runs each program once per block;
+// every instruction is a loop over the lanes, which the compiler turns into
+// SIMD. Lanes are doubles, giving the same values as getleftValue and
+// getrightValue while results stay below 2^53.
+// Pays off when shapes repeat: low nesting chance, or many evaluations of
+// one compiled set.
+const size_t batch_lanes = 256;
+
+class batch_evaluator
+{
+public:
+    void compile(const problem_set &set);
+    // results[i] is the value of problem i of the compiled set
+    void evaluate(std::vector<double> &results);
+    void evaluate(const problem_set &set, std::vector<double> &results);
+    size_t shape_count() const;
+
+private:
+    struct shape_group
+    {
+        std::string shape; // operator bytes in preorder, 0 for a literal
+        std::string code;
+        uint32_t literals;
+        uint32_t depth;
+        std::vector<uint32_t> problems;
+        std::vector<double> operands;
+    };
+    void run_block(const shape_group &group, size_t block, std::vector<double> &results);
+
+    std::unordered_multimap<uint64_t, uint32_t> shape_index;
+    std::vector<shape_group> groups;
+    std::vector<double> stack;
+    size_t problem_count = 0;
+};
+
+#include "batch_eval.cpp"
@@ -0,0 +1,176 @@
+//bench.cpp
+// Problems per second for each difficulty level, rejection vs constructive,
+// evaluation speed of exact_evaluator and batch_evaluator against
+// recursive long double, and formatting speed of format_problems against
+// operator<<
+// g++ -std=c++17 -O2 bench.cpp -o bench -pthread
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+#include "problem_set.h"
+#include "exact_eval.h"
+#include "batch_eval.h"
+#include "expression_format.h"
+
+int consoleWidth, consoleHeight;
+int mems;
+volatile long long sink;
+
+double single_thread_rate(long difficulty, bool constructive, double seconds)
+{
+    calulation c;
+    generator_context ctx(1, difficulty);
+    ctx.constructive = constructive;
+    long long count = 0, checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto stop = start + std::chrono::duration<double>(seconds);
+    while (std::chrono::steady_clock::now() < stop)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            c.random(ctx);
+            checksum += c.get_result();
+        }
+        count += 256;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink = checksum;
+    return count / elapsed;
+}
+
+double batch_rate(long difficulty, bool constructive, size_t count)
+{
+    auto start = std::chrono::steady_clock::now();
+    problem_set set = generate_problems(7, difficulty, count, 0, constructive);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return set.size() / elapsed;
+}
+
+// The evaluation getleftValue/getrightValue used to do, one node at a time
+long double evaluate_long_double(const expression_pool &pool, uint32_t index)
+{
+    const expression_node &node = pool[index];
+    if (node.op == 0)
+        return node.value;
+    long double l = evaluate_long_double(pool, node.left);
+    long double r = evaluate_long_double(pool, node.right);
+    switch (node.op)
+    {
+    case '+':
+        return l + r;
+    case '-':
+        return l - r;
+    case '*':
+        return l * r;
+    default:
+        return l / r;
+    }
+}
+
+void evaluation_rates(const char *name, const problem_set &set, int rounds)
+{
+    auto start = std::chrono::steady_clock::now();
+    long long checksum = 0;
+    for (int round = 0; round < rounds; round++)
+        for (size_t i = 0; i < set.size(); i++)
+            checksum += static_cast<int>(evaluate_long_double(set.get_pool(), set.get_root(i)));
+    double recursive = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    exact_evaluator integer(false), rational(true);
+    double exact[2];
+    for (int mode = 0; mode < 2; mode++)
+    {
+        exact_evaluator &evaluator = mode == 0 ? integer : rational;
+        evaluator.evaluate(set.get_pool()); // warm-up: first touch of the scratch arrays
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++)
+        {
+            evaluator.evaluate(set.get_pool());
+            for (size_t i = 0; i < set.size(); i++)
+            {
+                int64_t value = 0;
+                evaluator.get(set.get_root(i), value);
+                checksum -= value;
+            }
+        }
+        exact[mode] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    // batch: compile once and evaluate every round, and compile every round
+    batch_evaluator batch;
+    std::vector<double> results;
+    batch.evaluate(set, results);
+    double batch_time[2];
+    for (int mode = 0; mode < 2; mode++)
+    {
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++)
+        {
+            if (mode == 1)
+                batch.compile(set);
+            batch.evaluate(results);
+            for (double value : results)
+                checksum -= static_cast<long long>(value);
+        }
+        batch_time[mode] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    sink = checksum;
+    double problems = static_cast<double>(set.size()) * rounds;
+    std::printf("%-10s %16.0f %16.0f %16.0f %16.0f %16.0f %10zu\n", name, problems / recursive, problems / exact[0],
+                problems / exact[1], problems / batch_time[0], problems / batch_time[1], batch.shape_count());
+}
+
+void format_rates(const problem_set &set)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::ostringstream os;
+    calulation c;
+    for (size_t i = 0; i < set.size(); i++)
+    {
+        set.get(i, c);
+        os << c;
+        os << '\n';
+    }
+    double stream = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t bytes = os.str().size();
+
+    std::vector<char> buffer(1 << 20);
+    start = std::chrono::steady_clock::now();
+    long long checksum = 0;
+    for (size_t i = 0; i < set.size();)
+    {
+        size_t written = 0;
+        i = format_problems(set, i, set.size(), buffer.data(), buffer.size(), written);
+        checksum += buffer[written / 2];
+    }
+    double formatted = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink = checksum;
+    std::printf("%-10s %16.1f %16.1f\n", "format", bytes / stream / 1e6, bytes / formatted / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? std::atof(argv[1]) : 0.5;
+    std::printf("threads: %u\n", std::max(1u, std::thread::hardware_concurrency()));
+    std::printf("%-10s %16s %16s %16s %16s\n", "difficulty", "rejection/s", "constructive/s", "batch rej/s", "batch cons/s");
+    for (long difficulty = 1; difficulty <= 5; difficulty++)
+    {
+        double rejection = single_thread_rate(difficulty, false, seconds);
+        double constructive = single_thread_rate(difficulty, true, seconds);
+        double batch_rejection = batch_rate(difficulty, false, static_cast<size_t>(rejection * seconds));
+        double batch_constructive = batch_rate(difficulty, true, static_cast<size_t>(constructive * seconds));
+        std::printf("%-10ld %16.0f %16.0f %16.0f %16.0f\n", difficulty, rejection, constructive, batch_rejection,
+                    batch_constructive);
+    }
+
+    std::printf("\n%-10s %16s %16s %16s %16s %16s %10s\n", "eval", "long double/s", "int64/s", "rational/s",
+                "batch/s", "batch+compile/s", "shapes");
+    evaluation_rates("d5 cons", generate_problems(11, 5, 1000000, 0, true), 5);
+    evaluation_rates("d5 rej", generate_problems(11, 5, 200000, 0, false), 5);
+
+    std::printf("\n%-10s %16s %16s\n", "", "operator<< MB/s", "buffer MB/s");
+    format_rates(generate_problems(11, 5, 1000000, 0, true));
+    return 0;
+}
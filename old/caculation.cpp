@@ -1,12 +1,13 @@
 // caculation.cpp
 #pragma once
 #include "caculator.h"
+#include "generator_context.h"
+#include <algorithm>
 #include <string>
 #include <random>
 #include <iostream>
 
 const short chance = 6;
-const short max_member = 10;
 extern int consoleWidth, consoleHeight;
 const int max_target = 1000;
 
@@ -50,229 +51,387 @@ void get_difficulty_params(int difficulty, int &current_chance, int &max_value)
     }
 }
 
-auto safe_delete = [](void *ptr, bool is_calculation)
+// Legacy draws for the rand()/mems based overloads
+struct rand_source
 {
-    if (!ptr)
-        return;
-    is_calculation ? delete static_cast<calulation *>(ptr)
-                   : delete static_cast<int *>(ptr);
+    int &mems;
+    int max_member;
+    int draw(int n)
+    {
+        return rand() % n;
+    }
+    int draw_op()
+    {
+        return rand() % 4;
+    }
 };
 
-auto get_custom_string = [](void *ptr, bool is_calculation) -> std::string
+void calulation::new_tree()
 {
-    if (!ptr)
-        return "";
-    return is_calculation ? static_cast<calulation *>(ptr)->get_string()
-                          : std::to_string(*static_cast<int *>(ptr));
-};
+    pool.clear();
+    root = pool.add_node();
+}
 
-// New random Function
-bool calulation::random(long difficulty)
+// Builds one operand: a nested expression with chance 1/current_chance while
+// the mems budget lasts, otherwise a literal below max_value. A nested
+// expression is regenerated until its result fits in [-child_max, child_max]
+// (0 = only the max_target bound).
+template <class source>
+uint32_t calulation::random_child(source &src, int current_chance, int max_value, int child_max)
 {
-    int current_chance, max_value;
-    get_difficulty_params(difficulty, current_chance, max_value);
-
-    // Use the difficulty-specific parameters in random_left and random_right
-    random_left(current_chance, max_value);
-    random_right(current_chance, max_value);
-
-    switch (rand() % 4)
+    if (src.draw(current_chance) == 0 && src.mems < src.max_member)
     {
-    case 0:
-        op = '+';
-        result = getleftValue() + getrightValue();
-        break;
-    case 1:
-        op = '-';
-        result = getleftValue() - getrightValue();
-        break;
-    case 2:
-        op = '*';
-        result = getleftValue() * getrightValue();
-        break;
-    case 3:
-        op = '/';
-        while (getleftValue() == 0 || getrightValue() == 0 || int(getleftValue()) % int(getrightValue()) != 0)
+        uint32_t index = pool.add_node();
+        do
         {
-            random_left(current_chance, max_value);
-            random_right(current_chance, max_value);
-        }
-        result = getleftValue() / getrightValue();
-        break;
-    default:
-        op = '+';
-        result = getleftValue() + getrightValue();
-        break;
+            random_node(src, index, chance, 1000, 0);
+        } while (child_max != 0 && (pool[index].value > child_max || pool[index].value < -child_max));
+        src.mems++;
+        return index;
     }
-    if (result > max_target || result < -max_target)
-    {
-        random(difficulty);
+    return pool.add_leaf(src.draw(max_value));
+}
+
+// Fills node index with random operands and operator. Every node allocated
+// after index belongs to its subtree, so a retry truncates the pool back to
+// index + 1 and reuses the same slots.
+template <class source>
+void calulation::random_node(source &src, uint32_t index, int current_chance, int max_value, int child_max)
+{
+    while (true)
+    {
+        pool.truncate(index + 1);
+        uint32_t left = random_child(src, current_chance, max_value, child_max);
+        uint32_t right = random_child(src, current_chance, max_value, child_max);
+        long long value;
+        char op;
+        switch (src.draw_op())
+        {
+        case 0:
+            op = '+';
+            value = (long long)pool[left].value + pool[right].value;
+            break;
+        case 1:
+            op = '-';
+            value = (long long)pool[left].value - pool[right].value;
+            break;
+        case 2:
+            op = '*';
+            value = (long long)pool[left].value * pool[right].value;
+            break;
+        case 3:
+            op = '/';
+            while (pool[left].value == 0 || pool[right].value == 0 || pool[left].value % pool[right].value != 0)
+            {
+                pool.truncate(index + 1);
+                left = random_child(src, current_chance, max_value, child_max);
+                right = random_child(src, current_chance, max_value, child_max);
+            }
+            value = pool[left].value / pool[right].value;
+            break;
+        default:
+            op = '+';
+            value = (long long)pool[left].value + pool[right].value;
+            break;
+        }
+        expression_node &node = pool[index];
+        node.left = left;
+        node.right = right;
+        node.op = op;
+        node.value = static_cast<int32_t>(value);
+        if (value <= max_target && value >= -max_target)
+        {
+            return;
+        }
     }
+}
+
+// Integer range helpers for the constructive generator
+int floor_div(int a, int b)
+{
+    int q = a / b;
+    return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+}
+
+int ceil_div(int a, int b)
+{
+    int q = a / b;
+    return (a % b != 0 && ((a < 0) == (b < 0))) ? q + 1 : q;
+}
+
+template <class source>
+bool sample_range(source &src, int lo, int hi, int &out)
+{
+    if (lo > hi)
+        return false;
+    out = lo + src.draw(hi - lo + 1);
     return true;
 }
 
-bool calulation::random()
+// Like sample_range but never 0
+template <class source>
+bool sample_nonzero(source &src, int lo, int hi, int &out)
+{
+    if (lo > hi || (lo == 0 && hi == 0))
+        return false;
+    bool has_zero = lo <= 0 && hi >= 0;
+    out = lo + src.draw(hi - lo + 1 - (has_zero ? 1 : 0));
+    if (has_zero && out >= 0)
+        out++;
+    return true;
+}
+
+// Picks operand values for op so that left op right lies in [lo, hi], with
+// left in [l_lo, l_hi] and right in [r_lo, r_hi]. '*' and '/' draw the right
+// operand (the divisor) first and give up after a few unlucky draws.
+template <class source>
+bool pick_operands(source &src, char op, int lo, int hi, int l_lo, int l_hi, int r_lo, int r_hi, int &left, int &right)
 {
-    random_left();
-    random_right();
-    switch (rand() % 4)
+    switch (op)
     {
-    case 0:
-        op = '+';
-        result = getleftValue() + getrightValue();
-        break;
-    case 1:
-        op = '-';
-        result = getleftValue() - getrightValue();
-        break;
-    case 2:
-        op = '*';
-        result = getleftValue() * getrightValue();
-        break;
-    case 3:
-        op = '/';
-        while (getleftValue() == 0 || getrightValue() == 0 || int(getleftValue()) % int(getrightValue()) != 0)
+    case '+':
+        return sample_range(src, std::max(l_lo, lo - r_hi), std::min(l_hi, hi - r_lo), left) &&
+               sample_range(src, std::max(r_lo, lo - left), std::min(r_hi, hi - left), right);
+    case '-':
+        return sample_range(src, std::max(l_lo, lo + r_lo), std::min(l_hi, hi + r_hi), left) &&
+               sample_range(src, std::max(r_lo, left - hi), std::min(r_hi, left - lo), right);
+    case '*':
+        for (int attempt = 0; attempt < 4; attempt++)
         {
-            random_left();
-            random_right();
+            sample_range(src, r_lo, r_hi, right);
+            if (right == 0)
+            {
+                if (lo <= 0 && hi >= 0 && sample_range(src, l_lo, l_hi, left))
+                    return true;
+                continue;
+            }
+            int a = right > 0 ? ceil_div(lo, right) : ceil_div(hi, right);
+            int b = right > 0 ? floor_div(hi, right) : floor_div(lo, right);
+            if (sample_range(src, std::max(l_lo, a), std::min(l_hi, b), left))
+                return true;
         }
-        result = getleftValue() / getrightValue();
-        break;
+        return false;
     default:
-        op = '+';
-        result = getleftValue() + getrightValue();
-        break;
-    }
-    if (result > max_target || result < -max_target)
-    {
-        random();
+        for (int attempt = 0; attempt < 4; attempt++)
+        {
+            int quotient;
+            if (!sample_nonzero(src, r_lo, r_hi, right))
+                return false;
+            int a = right > 0 ? ceil_div(l_lo, right) : ceil_div(l_hi, right);
+            int b = right > 0 ? floor_div(l_hi, right) : floor_div(l_lo, right);
+            if (sample_nonzero(src, std::max(lo, a), std::min(hi, b), quotient))
+            {
+                left = quotient * right;
+                return true;
+            }
+        }
+        return false;
     }
-    return true;
 }
 
-bool calulation::random(std::string oper)
+// Constructive generation: the value range of node index is fixed up front
+// and each operand is drawn from the values that keep the node inside it,
+// so no subtree is ever thrown away. Nested operands are built to hit the
+// value drawn for them exactly. Cost is bounded by a few draws per node.
+template <class source>
+void calulation::random_constructive(source &src, uint32_t index, int lo, int hi, int current_chance, int max_value, int child_bound)
 {
-
-    safe_delete(left, leftIsCalculation);
-    safe_delete(right, rightIsCalculation);
-    rightIsCalculation = false;
-    right = new int(rand() % 1000);
-    leftIsCalculation = false;
-    left = new int(rand() % 1000);
-    if (oper == "1")
+    bool nested[2];
+    for (bool &n : nested)
     {
-        op = '+';
-        result = getleftValue() + getrightValue();
+        n = src.draw(current_chance) == 0 && src.mems < src.max_member;
+        if (n)
+            src.mems++;
     }
-    else if (oper == "2")
+    int range[2][2];
+    for (int i = 0; i < 2; i++)
     {
-        op = '-';
-        result = getleftValue() - getrightValue();
+        range[i][0] = nested[i] ? -child_bound : 0;
+        range[i][1] = nested[i] ? child_bound : max_value - 1;
     }
-    else if (oper == "3")
+
+    static const char ops[4] = {'+', '-', '*', '/'};
+    int first = src.draw_op();
+    char op = 0;
+    int values[2];
+    for (int i = 0; i < 4 && op == 0; i++)
     {
-        op = '*';
-        result = getleftValue() * getrightValue();
+        char candidate = ops[(first + i) % 4];
+        if (pick_operands(src, candidate, lo, hi, range[0][0], range[0][1], range[1][0], range[1][1], values[0], values[1]))
+            op = candidate;
     }
-    else if (oper == "4")
+    if (op == 0)
     {
+        // Two literals can always reach some value of [lo, hi] by '-'
+        for (int i = 0; i < 2; i++)
+        {
+            if (nested[i])
+                src.mems--;
+            nested[i] = false;
+        }
+        op = '-';
+        pick_operands(src, op, lo, hi, 0, max_value - 1, 0, max_value - 1, values[0], values[1]);
+    }
 
-        op = '/';
-        while (getleftValue() == 0 || getrightValue() == 0 || int(getleftValue()) % int(getrightValue()) != 0)
+    uint32_t children[2];
+    for (int i = 0; i < 2; i++)
+    {
+        if (nested[i])
+        {
+            children[i] = pool.add_node();
+            random_constructive(src, children[i], values[i], values[i], chance, 1000, 999);
+        }
+        else
         {
-            right = new int(rand() % 1000);
-            left = new int(rand() % 1000);
+            children[i] = pool.add_leaf(values[i]);
         }
-        result = getleftValue() / getrightValue();
     }
-    else
+    expression_node &node = pool[index];
+    node.left = children[0];
+    node.right = children[1];
+    node.op = op;
+    switch (op)
     {
-        random();
+    case '+':
+        node.value = values[0] + values[1];
+        break;
+    case '-':
+        node.value = values[0] - values[1];
+        break;
+    case '*':
+        node.value = values[0] * values[1];
+        break;
+    default:
+        node.value = values[0] / values[1];
+        break;
     }
-    return true;
 }
 
-bool calulation::random(std::string oper, short mode)
+// Two literals below 1000, right operand drawn first, with operator oper.
+// Returns false for an unknown operator after drawing the literals.
+bool calulation::random_leaves(uint32_t index, char oper)
 {
-
-    safe_delete(left, leftIsCalculation);
-    safe_delete(right, rightIsCalculation);
-    rightIsCalculation = false;
-    right = new int(rand() % 1000);
-    leftIsCalculation = false;
-    left = new int(rand() % 1000);
-    if (oper == "1")
+    pool.truncate(index + 1);
+    uint32_t right = pool.add_leaf(rand() % 1000);
+    uint32_t left = pool.add_leaf(rand() % 1000);
+    if (oper == 0)
     {
-        op = '+';
-        result = getleftValue() + getrightValue();
+        return false;
     }
-    else if (oper == "2")
+    if (oper == '/')
     {
-        op = '-';
-        result = getleftValue() - getrightValue();
+        while (pool[left].value == 0 || pool[right].value == 0 || pool[left].value % pool[right].value != 0)
+        {
+            pool.truncate(index + 1);
+            right = pool.add_leaf(rand() % 1000);
+            left = pool.add_leaf(rand() % 1000);
+        }
     }
-    else if (oper == "3")
+    int32_t l = pool[left].value, r = pool[right].value;
+    expression_node &node = pool[index];
+    node.left = left;
+    node.right = right;
+    node.op = oper;
+    switch (oper)
     {
-        op = '*';
-        result = getleftValue() * getrightValue();
+    case '+':
+        node.value = l + r;
+        break;
+    case '-':
+        node.value = l - r;
+        break;
+    case '*':
+        node.value = l * r;
+        break;
+    default:
+        node.value = l / r;
+        break;
     }
-    else if (oper == "4")
-    {
+    return true;
+}
 
-        op = '/';
-        while (getleftValue() == 0 || getrightValue() == 0 || int(getleftValue()) % int(getrightValue()) != 0)
-        {
-            right = new int(rand() % 1000);
-            left = new int(rand() % 1000);
-        }
-        result = getleftValue() / getrightValue();
+// New random Function
+bool calulation::random(long difficulty)
+{
+    int current_chance, max_value;
+    get_difficulty_params(difficulty, current_chance, max_value);
+
+    // Use the difficulty-specific parameters for the operands; nested
+    // expressions are bounded by the matching level as before
+    rand_source src{mems, max_member};
+    new_tree();
+    random_node(src, root, current_chance, max_value, get_difficulty_params_for_child(current_chance, max_value));
+    result = pool[root].value;
+    return true;
+}
+
+bool calulation::random()
+{
+    rand_source src{mems, max_member};
+    new_tree();
+    random_node(src, root, chance, 1000, 0);
+    result = pool[root].value;
+    return true;
+}
+
+bool calulation::random(generator_context &ctx)
+{
+    ctx.mems = 1;
+    new_tree();
+    if (ctx.constructive)
+    {
+        random_constructive(ctx, root, -max_target, max_target, ctx.current_chance, ctx.max_value,
+                            ctx.child_max != 0 ? ctx.child_max : 999);
     }
     else
     {
-        random(mode);
+        random_node(ctx, root, ctx.current_chance, ctx.max_value, ctx.child_max);
     }
+    result = pool[root].value;
     return true;
 }
 
-bool calulation::random(short mode)
+// oper "1" to "4" selects + - * /, anything else falls back to random()
+char get_oper(const std::string &oper)
+{
+    if (oper == "1")
+        return '+';
+    if (oper == "2")
+        return '-';
+    if (oper == "3")
+        return '*';
+    if (oper == "4")
+        return '/';
+    return 0;
+}
+
+bool calulation::random(std::string oper)
 {
-    random_left();
-    random_right();
-    switch (rand() % 4)
+    new_tree();
+    if (!random_leaves(root, get_oper(oper)))
     {
-    case 0:
-        op = '+';
-        result = getleftValue() + getrightValue();
-        break;
-    case 1:
-        op = '-';
-        result = getleftValue() - getrightValue();
-        break;
-    case 2:
-        op = '*';
-        result = getleftValue() * getrightValue();
-        break;
-    case 3:
-        op = '/';
-        while (getleftValue() == 0 || getrightValue() == 0 || int(getleftValue()) % int(getrightValue()) != 0)
-        {
-            random_left();
-            random_right();
-        }
-        result = getleftValue() / getrightValue();
-        break;
-    default:
-        op = '+';
-        result = getleftValue() + getrightValue();
-        break;
+        return random();
     }
-    if (result > max_target || result < -max_target)
+    result = pool[root].value;
+    return true;
+}
+
+bool calulation::random(std::string oper, short mode)
+{
+    new_tree();
+    if (!random_leaves(root, get_oper(oper)))
     {
-        random();
+        return random(mode);
     }
+    result = pool[root].value;
     return true;
 }
 
+bool calulation::random(short mode)
+{
+    return random();
+}
+
 bool calulation::random(int max)
 {
     do
@@ -306,183 +465,186 @@ int getOperatorPriority(char op)
         return 0;
     }
 }
-void calulation::output(std::ostream &os) const
+
+bool needs_parentheses(char parent, char child, bool right)
 {
-    if (leftIsCalculation)
+    if (child == 0)
     {
-        os << "(";
-        ((calulation *)left)->output(os);
-        os << ")";
+        return false;
     }
-    else
+    int parentPriority = getOperatorPriority(parent);
+    int childPriority = getOperatorPriority(child);
+    return childPriority < parentPriority ||
+           (right && childPriority == parentPriority && (parent == '-' || parent == '/'));
+}
+
+void calulation::output_node(std::ostream &os, uint32_t index) const
+{
+    const expression_node &node = pool[index];
+    if (pool.is_leaf(node.left))
     {
-        os << *(int *)left;
+        os << pool[node.left].value;
     }
-    os << op;
-    if (rightIsCalculation)
+    else
     {
         os << "(";
-        ((calulation *)right)->output(os);
+        output_node(os, node.left);
         os << ")";
     }
+    os << node.op;
+    if (pool.is_leaf(node.right))
+    {
+        os << pool[node.right].value;
+    }
     else
     {
-        os << *(int *)right;
+        os << "(";
+        output_node(os, node.right);
+        os << ")";
     }
 }
 
-void calulation::output(std::ostream &os, int parentPriority) const
+void calulation::output_node(std::ostream &os, uint32_t index, int parentPriority) const
 {
-    int currentPriority = getOperatorPriority(op);
+    const expression_node &node = pool[index];
+    int currentPriority = getOperatorPriority(node.op);
 
-    if (leftIsCalculation)
+    if (pool.is_leaf(node.left))
     {
-        if (get_op() != ((calulation *)left)->get_op())
+        os << pool[node.left].value;
+    }
+    else
+    {
+        bool parentheses = needs_parentheses(node.op, pool[node.left].op, false);
+        if (parentheses)
         {
             os << "(";
         }
-        ((calulation *)left)->output(os, currentPriority);
-        if (get_op() != ((calulation *)left)->get_op())
+        output_node(os, node.left, currentPriority);
+        if (parentheses)
         {
             os << ")";
         }
     }
-    else
+    os << node.op;
+
+    if (pool.is_leaf(node.right))
     {
-        os << *(int *)left;
+        os << pool[node.right].value;
     }
-    os << op;
-
-    if (rightIsCalculation)
+    else
     {
-        if (get_op() != ((calulation *)right)->get_op())
+        bool parentheses = needs_parentheses(node.op, pool[node.right].op, true);
+        if (parentheses)
         {
             os << "(";
         }
-        ((calulation *)right)->output(os, currentPriority);
-        if (get_op() != ((calulation *)right)->get_op())
+        output_node(os, node.right, currentPriority);
+        if (parentheses)
         {
             os << ")";
         }
     }
-    else
+}
+
+void calulation::output(std::ostream &os) const
+{
+    if (!pool.empty())
     {
-        os << *(int *)right;
+        output_node(os, root);
+    }
+}
+
+void calulation::output(std::ostream &os, int parentPriority) const
+{
+    if (!pool.empty())
+    {
+        output_node(os, root, parentPriority);
     }
 }
 
 char calulation::get_op() const
 {
-    return op;
+    return pool.empty() ? 0 : pool[root].op;
 }
 
-calulation::~calulation()
+const expression_pool &calulation::get_pool() const
 {
-    safe_delete(left, leftIsCalculation);
-    safe_delete(right, rightIsCalculation);
+    return pool;
+}
+
+uint32_t calulation::get_root() const
+{
+    return root;
+}
 
-    left = nullptr;
-    right = nullptr;
+void calulation::assign(const expression_pool &from, uint32_t index)
+{
+    pool.clear();
+    root = pool.append_tree(from, index);
+    result = pool[root].value;
+}
+
+calulation::~calulation()
+{
 }
 
 calulation::calulation()
 {
-    left = nullptr;
-    right = nullptr;
-    leftIsCalculation = false;
-    rightIsCalculation = false;
+    result = 0;
+    root = no_node;
+    pool.reserve(4 * max_member);
+}
+
+long double calulation::child_value(uint32_t child) const
+{
+    return child == no_node ? 0 : static_cast<long double>(pool[child].value);
 }
 
 long double calulation::getleftValue()
 {
-    if (leftIsCalculation)
-    {
-        return ((calulation *)left)->result;
-    }
-    else
-    {
-        return static_cast<long double>(*((int *)left));
-    }
+    return pool.empty() ? 0 : child_value(pool[root].left);
 }
 
 long double calulation::getrightValue()
 {
-    if (rightIsCalculation)
-    {
-        return ((calulation *)right)->result;
-    }
-    else
-    {
-        return static_cast<long double>(*((int *)right));
-    }
+    return pool.empty() ? 0 : child_value(pool[root].right);
 }
 // new random_left Function
 void calulation::random_left(int current_chance, int max_value)
 {
-    safe_delete(left, leftIsCalculation);
-    if (rand() % current_chance == 0 && mems < max_member)
-    {
-        leftIsCalculation = true;
-        left = new calulation();
-        ((calulation *)left)->random(get_difficulty_params_for_child(current_chance, max_value));
-        mems++;
-    }
-    else
-    {
-        leftIsCalculation = false;
-        left = new int(rand() % max_value);
-    }
+    if (pool.empty())
+        new_tree();
+    rand_source src{mems, max_member};
+    uint32_t left = random_child(src, current_chance, max_value, get_difficulty_params_for_child(current_chance, max_value));
+    pool[root].left = left;
 }
 // original random_left Function
 void calulation::random_left()
 {
-    safe_delete(left, leftIsCalculation);
-    if (rand() % chance == 0 && mems < max_member)
-    {
-        leftIsCalculation = true;
-        left = new calulation();
-        ((calulation *)left)->random();
-        mems++;
-    }
-    else
-    {
-        leftIsCalculation = false;
-        left = new int(rand() % 1000);
-    }
+    if (pool.empty())
+        new_tree();
+    rand_source src{mems, max_member};
+    uint32_t left = random_child(src, chance, 1000, 0);
+    pool[root].left = left;
 }
 // new random_right Function
 void calulation::random_right(int current_chance, int max_value)
 {
-    safe_delete(right, rightIsCalculation);
-    if (rand() % current_chance == 0 && mems < max_member)
-    {
-        rightIsCalculation = true;
-        right = new calulation();
-        ((calulation *)right)->random(get_difficulty_params_for_child(current_chance, max_value));
-        mems++;
-    }
-    else
-    {
-        rightIsCalculation = false;
-        right = new int(rand() % max_value);
-    }
+    if (pool.empty())
+        new_tree();
+    rand_source src{mems, max_member};
+    uint32_t right = random_child(src, current_chance, max_value, get_difficulty_params_for_child(current_chance, max_value));
+    pool[root].right = right;
 }
 // original random_right Function
 void calulation::random_right()
 {
-    safe_delete(right, rightIsCalculation);
-    if (rand() % chance == 0 && mems < max_member)
-    {
-        rightIsCalculation = true;
-        right = new calulation();
-        ((calulation *)right)->random();
-        mems++;
-    }
-    else
-    {
-        rightIsCalculation = false;
-        right = new int(rand() % 1000);
-    }
+    if (pool.empty())
+        new_tree();
+    rand_source src{mems, max_member};
+    uint32_t right = random_child(src, chance, 1000, 0);
+    pool[root].right = right;
 }
 // new function
 int calulation::get_difficulty_params_for_child(int current_chance, int max_value)
@@ -504,7 +666,48 @@ int calulation::get_result()
     return static_cast<int>(result);
 }
 
+void calulation::append_string(std::string &out, uint32_t index) const
+{
+    const expression_node &node = pool[index];
+    if (pool.is_leaf(index))
+    {
+        out += std::to_string(node.value);
+        return;
+    }
+    bool parentheses = needs_parentheses(node.op, pool[node.left].op, false);
+    if (parentheses)
+    {
+        out += '(';
+    }
+    append_string(out, node.left);
+    if (parentheses)
+    {
+        out += ')';
+    }
+    out += node.op;
+    parentheses = needs_parentheses(node.op, pool[node.right].op, true);
+    if (parentheses)
+    {
+        out += '(';
+    }
+    append_string(out, node.right);
+    if (parentheses)
+    {
+        out += ')';
+    }
+}
+
 std::string calulation::get_string() const
 {
-    return get_custom_string(left, leftIsCalculation) + op + get_custom_string(right, rightIsCalculation);
+    std::string out;
+    if (!pool.empty())
+    {
+        append_string(out, root);
+    }
+    return out;
+}
+
+uint64_t calulation::get_hash() const
+{
+    return pool.empty() ? 0 : canonical_hash(pool, root);
 }
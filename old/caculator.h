@@ -3,6 +3,10 @@
 
 #include <ostream>
 #include <string>
+#include "expression_pool.h"
+#include "problem_hash.h"
+
+class generator_context;
 
 class calulation
 {
@@ -20,6 +24,8 @@ public:
     bool random(int max);
     bool random(short mode);
     bool random(std::string oper,int max);
+    // Reentrant variant: draws from ctx instead of rand() and mems
+    bool random(generator_context &ctx);
     calulation(int ileft, char iop, int iright);
     calulation(calulation ileft, char iop, calulation iright);
     ~calulation();
@@ -34,16 +40,37 @@ public:
     int get_result();
     int get_difficulty_params_for_child(int current_chance,int max_value);
     std::string get_string() const;
+    // canonical_hash of the tree, equal for problems differing only in the
+    // operand order of '+' and '*'
+    uint64_t get_hash() const;
     char get_op() const;
+    const expression_pool &get_pool() const;
+    uint32_t get_root() const;
+    // Replaces this problem by a copy of the tree at index in from
+    void assign(const expression_pool &from, uint32_t index);
     
 
 private:
-    char op;
-    void * left;
-    bool leftIsCalculation;
-    void * right;
-    bool rightIsCalculation;
-    
+    // The whole tree lives in pool, this problem is node root
+    expression_pool pool;
+    uint32_t root;
+    void new_tree();
+    template <class source>
+    uint32_t random_child(source &src, int current_chance, int max_value, int child_max);
+    template <class source>
+    void random_node(source &src, uint32_t index, int current_chance, int max_value, int child_max);
+    template <class source>
+    void random_constructive(source &src, uint32_t index, int lo, int hi, int current_chance, int max_value, int child_bound);
+    bool random_leaves(uint32_t index, char oper);
+    void output_node(std::ostream &os, uint32_t index) const;
+    void output_node(std::ostream &os, uint32_t index, int parentPriority) const;
+    void append_string(std::string &out, uint32_t index) const;
+    long double child_value(uint32_t child) const;
 };
 
+// Whether a nested operand with operator child prints in parentheses under
+// parent: when it binds looser, or as the right operand of '-' or '/' at
+// the same priority (a-(b-c) is not a-b-c). Literals (child 0) never do.
+bool needs_parentheses(char parent, char child, bool right);
+
 #include "caculation.cpp"
\ No newline at end of file
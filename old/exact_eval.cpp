@@ -0,0 +1,274 @@
+// exact_eval.cpp
+#pragma once
+#include "exact_eval.h"
+#include "caculator.h"
+
+bool checked_add(int64_t a, int64_t b, int64_t &out)
+{
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+        return false;
+    out = a + b;
+    return true;
+}
+
+bool checked_sub(int64_t a, int64_t b, int64_t &out)
+{
+    if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b))
+        return false;
+    out = a - b;
+    return true;
+}
+
+// Products of two values that fit in 32 bits cannot overflow, which skips
+// the divisions below for almost every node of a generated problem
+static inline bool fits_int32(int64_t v)
+{
+    return static_cast<uint64_t>(v + 0x80000000LL) <= 0xffffffffULL;
+}
+
+bool checked_mul(int64_t a, int64_t b, int64_t &out)
+{
+    if (fits_int32(a) && fits_int32(b))
+    {
+        out = a * b;
+        return true;
+    }
+    if (a > 0 ? (b > 0 ? a > INT64_MAX / b : b < INT64_MIN / a)
+              : (b > 0 ? a < INT64_MIN / b : (a != 0 && b < INT64_MAX / a)))
+        return false;
+    out = a * b;
+    return true;
+}
+
+static int64_t gcd64(int64_t a, int64_t b)
+{
+    uint64_t x = a < 0 ? 0 - static_cast<uint64_t>(a) : static_cast<uint64_t>(a);
+    uint64_t y = b < 0 ? 0 - static_cast<uint64_t>(b) : static_cast<uint64_t>(b);
+    while (y != 0)
+    {
+        uint64_t t = x % y;
+        x = y;
+        y = t;
+    }
+    return static_cast<int64_t>(x);
+}
+
+// Rational arithmetic on reduced operands with a positive denominator.
+// Common factors are divided out before multiplying, but a cross product
+// can still overflow when the reduced result would fit; that is reported
+// as overflow, never as a wrong value.
+static eval_status rational_add(const exact_value &l, const exact_value &r, bool subtract, exact_value &out)
+{
+    int64_t g = gcd64(l.den, r.den);
+    int64_t a, b, num, den;
+    if (!checked_mul(l.num, r.den / g, a) || !checked_mul(r.num, l.den / g, b) ||
+        !(subtract ? checked_sub(a, b, num) : checked_add(a, b, num)) || !checked_mul(l.den / g, r.den, den))
+        return eval_status::overflow;
+    g = gcd64(num, den);
+    out.num = num / g;
+    out.den = den / g;
+    return eval_status::ok;
+}
+
+static eval_status rational_mul(int64_t ln, int64_t ld, int64_t rn, int64_t rd, exact_value &out)
+{
+    if (rd < 0)
+    {
+        if (rn == INT64_MIN || rd == INT64_MIN)
+            return eval_status::overflow;
+        rn = -rn;
+        rd = -rd;
+    }
+    int64_t g1 = gcd64(ln, rd), g2 = gcd64(rn, ld);
+    if (!checked_mul(ln / g1, rn / g2, out.num) || !checked_mul(ld / g2, rd / g1, out.den))
+        return eval_status::overflow;
+    return eval_status::ok;
+}
+
+exact_evaluator::exact_evaluator(bool rational) : rational(rational), base(0)
+{
+}
+
+void exact_evaluator::set_rational(bool rational)
+{
+    this->rational = rational;
+}
+
+void exact_evaluator::evaluate(const expression_pool &pool)
+{
+    evaluate(pool, 0, pool.size());
+}
+
+// Rational node: either operand has a denominator other than 1
+static eval_status rational_node(char op, const exact_value &a, const exact_value &b, exact_value &v)
+{
+    switch (op)
+    {
+    case '+':
+        return rational_add(a, b, false, v);
+    case '-':
+        return rational_add(a, b, true, v);
+    case '*':
+        return rational_mul(a.num, a.den, b.num, b.den, v);
+    default:
+        return b.num == 0 ? eval_status::division_by_zero : rational_mul(a.num, a.den, b.den, b.num, v);
+    }
+}
+
+eval_status exact_apply(char op, const exact_value &a, const exact_value &b, exact_value &out)
+{
+    out.status = rational_node(op, a, b, out);
+    return out.status;
+}
+
+// Integer node whose operands do not both fit in 32 bits
+static eval_status wide_node(char op, int64_t a, int64_t b, int64_t &v)
+{
+    switch (op)
+    {
+    case '+':
+        return checked_add(a, b, v) ? eval_status::ok : eval_status::overflow;
+    case '-':
+        return checked_sub(a, b, v) ? eval_status::ok : eval_status::overflow;
+    case '*':
+        return checked_mul(a, b, v) ? eval_status::ok : eval_status::overflow;
+    default:
+        if (b == 0)
+            return eval_status::division_by_zero;
+        if (a == INT64_MIN && b == -1)
+            return eval_status::overflow;
+        if (a % b != 0)
+            return eval_status::inexact;
+        v = a / b;
+        return eval_status::ok;
+    }
+}
+
+// A failed node holds failed_value and its reason in status; status of
+// every other node is never written, so the common path stores one value.
+// nodes[0, n) are the nodes from first on, child indices are relative to it.
+template <bool rational>
+static void evaluate_nodes(const expression_node *nodes, uint32_t n, uint32_t first, int64_t *nv, int64_t *dv, eval_status *sv)
+{
+    for (uint32_t i = n; i-- > 0;)
+    {
+        const expression_node &node = nodes[i];
+        if (node.op == 0)
+        {
+            nv[i] = node.value;
+            if (rational)
+                dv[i] = 1;
+            continue;
+        }
+        uint32_t l = node.left - first, r = node.right - first;
+        int64_t a = nv[l], b = nv[r], v = 0;
+        if (a == failed_value || b == failed_value)
+        {
+            nv[i] = failed_value;
+            sv[i] = a == failed_value ? sv[l] : sv[r];
+            continue;
+        }
+
+        eval_status s = eval_status::ok;
+        if (rational && (dv[l] != 1 || dv[r] != 1))
+        {
+            exact_value q{0, 1, eval_status::ok};
+            s = rational_node(node.op, {a, dv[l], eval_status::ok}, {b, dv[r], eval_status::ok}, q);
+            v = q.num;
+            dv[i] = q.den;
+        }
+        else if (fits_int32(a) && fits_int32(b) && node.op != '/')
+        {
+            // Nothing can overflow. Selected without a branch: the operator
+            // sequence is random, so a switch here mispredicts on most nodes
+            int64_t sum = a + b, difference = a - b, product = a * b;
+            v = node.op == '+' ? sum : (node.op == '-' ? difference : product);
+            if (rational)
+                dv[i] = 1;
+        }
+        else if (fits_int32(a) && fits_int32(b) && b != 0 && b != -1 && static_cast<int32_t>(a) % static_cast<int32_t>(b) == 0)
+        {
+            // Exact 32-bit division, much cheaper than the 64-bit divide
+            v = static_cast<int32_t>(a) / static_cast<int32_t>(b);
+            if (rational)
+                dv[i] = 1;
+        }
+        else
+        {
+            s = wide_node(node.op, a, b, v);
+            if (rational)
+            {
+                dv[i] = 1;
+                if (s == eval_status::inexact)
+                {
+                    exact_value q{0, 1, eval_status::ok};
+                    s = rational_mul(a, 1, 1, b, q);
+                    v = q.num;
+                    dv[i] = q.den;
+                }
+            }
+        }
+        if (s == eval_status::ok && v == failed_value)
+            s = eval_status::overflow;
+        if (s != eval_status::ok)
+        {
+            v = failed_value;
+            sv[i] = s;
+        }
+        nv[i] = v;
+    }
+}
+
+void exact_evaluator::evaluate(const expression_pool &pool, uint32_t first, uint32_t last)
+{
+    uint32_t n = last - first;
+    base = first;
+    if (n == 0)
+        return;
+    if (num.size() < n)
+    {
+        num.resize(n);
+        status.resize(n);
+    }
+    if (rational)
+    {
+        if (den.size() < n)
+            den.resize(n);
+        evaluate_nodes<true>(&pool[first], n, first, num.data(), den.data(), status.data());
+    }
+    else
+    {
+        evaluate_nodes<false>(&pool[first], n, first, num.data(), nullptr, status.data());
+    }
+}
+
+exact_value exact_evaluator::get(uint32_t index) const
+{
+    index -= base;
+    if (num[index] == failed_value)
+        return {0, 0, status[index]};
+    return {num[index], rational ? den[index] : 1, eval_status::ok};
+}
+
+eval_status exact_evaluator::get(uint32_t index, int64_t &out) const
+{
+    index -= base;
+    if (num[index] == failed_value)
+        return status[index];
+    if (rational && den[index] != 1)
+        return eval_status::inexact;
+    out = num[index];
+    return eval_status::ok;
+}
+
+eval_status exact_evaluator::evaluate(const calulation &c, int64_t &out)
+{
+    const expression_pool &pool = c.get_pool();
+    if (pool.empty())
+    {
+        out = 0;
+        return eval_status::ok;
+    }
+    evaluate(pool);
+    return get(c.get_root(), out);
+}
@@ -0,0 +1,63 @@
+//exact_eval.h
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "expression_pool.h"
+
+class calulation;
+
+enum class eval_status : uint8_t
+{
+    ok,
+    overflow,
+    division_by_zero,
+    inexact // integer mode only: a '/' left a remainder
+};
+
+// Exact value of one node, num / den with den > 0 and gcd(num, den) == 1
+struct exact_value
+{
+    int64_t num;
+    int64_t den;
+    eval_status status;
+};
+
+// INT64_MIN marks a failed node and therefore counts as overflow
+const int64_t failed_value = INT64_MIN;
+
+// Evaluates trees with checked 64-bit integers, or with 64-bit rationals
+// when rational is set, instead of long double. A child always sits after
+// its parent in an expression_pool, so one pass from the last node down to
+// the first sees every child before its parent and needs no recursion.
+class exact_evaluator
+{
+public:
+    explicit exact_evaluator(bool rational = false);
+    void set_rational(bool rational);
+    // Values for every node of pool, including every tree of a problem_set
+    void evaluate(const expression_pool &pool);
+    // Values for nodes [first, last) only, which must hold whole trees
+    // (problem_set::get_root(i) to get_end(i)); scratch stays in cache
+    void evaluate(const expression_pool &pool, uint32_t first, uint32_t last);
+    exact_value get(uint32_t index) const;
+    // Integer result of node index; inexact in rational mode if not whole
+    eval_status get(uint32_t index, int64_t &out) const;
+    eval_status evaluate(const calulation &c, int64_t &out);
+
+private:
+    bool rational;
+    uint32_t base;
+    // Struct of arrays: integer mode never touches den
+    std::vector<int64_t> num;
+    std::vector<int64_t> den;
+    std::vector<eval_status> status;
+};
+
+bool checked_add(int64_t a, int64_t b, int64_t &out);
+bool checked_sub(int64_t a, int64_t b, int64_t &out);
+bool checked_mul(int64_t a, int64_t b, int64_t &out);
+// out = a op b for reduced rationals with den > 0, as rational mode does
+eval_status exact_apply(char op, const exact_value &a, const exact_value &b, exact_value &out);
+
+#include "exact_eval.cpp"
@@ -0,0 +1,257 @@
+//exact_eval_check.cpp
+// Property check of exact_evaluator against a reference evaluator on
+// __int128 rationals: random trees, both integer and rational mode, every
+// node's value and overflow / division-by-zero / inexact status
+// g++ -std=c++17 -O2 exact_eval_check.cpp -o exact_eval_check -pthread
+// exact_eval_check [trees] [seed]
+#include <cstdio>
+#include <cstdlib>
+#include "problem_set.h"
+#include "exact_eval.h"
+
+int consoleWidth, consoleHeight;
+int mems;
+
+typedef __int128 wide;
+
+struct reference_value
+{
+    wide num;
+    wide den;
+    eval_status status;
+    bool conservative; // rational mode may report overflow in this subtree
+};
+
+static wide wide_abs(wide v)
+{
+    return v < 0 ? -v : v;
+}
+
+static wide wide_gcd(wide a, wide b)
+{
+    a = wide_abs(a);
+    b = wide_abs(b);
+    while (b != 0)
+    {
+        wide t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// failed_value (INT64_MIN) is the evaluator's failure mark, so it never
+// counts as a representable result
+static bool fits(wide v)
+{
+    return v > INT64_MIN && v <= INT64_MAX;
+}
+
+static bool fits_int64(wide v)
+{
+    return v >= INT64_MIN && v <= INT64_MAX;
+}
+
+// The products rational_add / rational_mul form before reducing; the
+// evaluator reports overflow if one of them leaves int64 even when the
+// reduced result would fit
+static bool cross_products_fit(char op, wide ln, wide ld, wide rn, wide rd)
+{
+    if (op == '/')
+    {
+        wide t = rn;
+        rn = rd;
+        rd = t;
+        if (rd < 0)
+        {
+            if (!fits_int64(-rn) || !fits_int64(-rd) || rn == INT64_MIN || rd == INT64_MIN)
+                return false;
+            rn = -rn;
+            rd = -rd;
+        }
+    }
+    if (op == '+' || op == '-')
+    {
+        wide g = wide_gcd(ld, rd);
+        wide a = ln * (rd / g), b = rn * (ld / g);
+        wide sum = op == '+' ? a + b : a - b;
+        return fits_int64(a) && fits_int64(b) && fits_int64(sum) && fits_int64((ld / g) * rd);
+    }
+    wide g1 = wide_gcd(ln, rd), g2 = wide_gcd(rn, ld);
+    return fits_int64((ln / g1) * (rn / g2)) && fits_int64((ld / g2) * (rd / g1));
+}
+
+static reference_value reference(const expression_pool &pool, uint32_t index, bool rational)
+{
+    const expression_node &node = pool[index];
+    if (node.op == 0)
+        return {node.value, 1, eval_status::ok, false};
+    reference_value l = reference(pool, node.left, rational);
+    reference_value r = reference(pool, node.right, rational);
+    bool conservative = l.conservative || r.conservative;
+    if (l.status != eval_status::ok)
+        return {0, 1, l.status, conservative};
+    if (r.status != eval_status::ok)
+        return {0, 1, r.status, conservative};
+
+    if (node.op == '/' && r.num == 0)
+        return {0, 1, eval_status::division_by_zero, conservative};
+    if (rational && (l.den != 1 || r.den != 1 || node.op == '/'))
+        conservative = conservative || !cross_products_fit(node.op, l.num, l.den, r.num, r.den);
+
+    wide num, den;
+    switch (node.op)
+    {
+    case '+':
+        num = l.num * r.den + r.num * l.den;
+        den = l.den * r.den;
+        break;
+    case '-':
+        num = l.num * r.den - r.num * l.den;
+        den = l.den * r.den;
+        break;
+    case '*':
+        num = l.num * r.num;
+        den = l.den * r.den;
+        break;
+    default:
+        num = l.num * r.den;
+        den = l.den * r.num;
+        break;
+    }
+    if (den < 0)
+    {
+        num = -num;
+        den = -den;
+    }
+    wide g = wide_gcd(num, den);
+    num /= g;
+    den /= g;
+    if (!rational && den != 1)
+        return {0, 1, eval_status::inexact, conservative};
+    if (!fits(num) || !fits(den))
+        return {0, 1, eval_status::overflow, conservative};
+    return {num, den, eval_status::ok, conservative};
+}
+
+// Leaves favour values that make the interesting cases likely: zero for
+// division by zero, +-1 and small numbers for exact quotients, and values
+// near the int32 limits so a few products overflow int64
+static int32_t random_leaf(xoshiro256 &rng)
+{
+    switch (rng.below(8))
+    {
+    case 0:
+        return 0;
+    case 1:
+        return rng.below(2) ? 1 : -1;
+    case 2:
+        return rng.below(2) ? INT32_MAX - static_cast<int32_t>(rng.below(4))
+                            : INT32_MIN + static_cast<int32_t>(rng.below(4));
+    case 3:
+        return static_cast<int32_t>(rng.next());
+    default:
+        return static_cast<int32_t>(rng.below(201)) - 100;
+    }
+}
+
+// Preorder, a node before its children, as every expression_pool holds it
+static uint32_t random_tree(expression_pool &pool, xoshiro256 &rng, int depth)
+{
+    if (depth == 0 || rng.below(4) == 0)
+        return pool.add_leaf(random_leaf(rng));
+    static const char ops[4] = {'+', '-', '*', '/'};
+    uint32_t index = pool.add_node();
+    uint32_t left = random_tree(pool, rng, depth - 1);
+    uint32_t right = random_tree(pool, rng, depth - 1);
+    expression_node &node = pool[index];
+    node.op = ops[rng.below(4)];
+    node.left = left;
+    node.right = right;
+    return index;
+}
+
+static const char *status_name(eval_status s)
+{
+    switch (s)
+    {
+    case eval_status::ok:
+        return "ok";
+    case eval_status::overflow:
+        return "overflow";
+    case eval_status::division_by_zero:
+        return "division_by_zero";
+    default:
+        return "inexact";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t trees = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+
+    xoshiro256 rng(seed);
+    expression_pool pool;
+    for (size_t t = 0; t < trees; t++)
+        random_tree(pool, rng, 1 + static_cast<int>(rng.below(8)));
+
+    long long failures = 0;
+    for (int mode = 0; mode < 2; mode++)
+    {
+        bool rational = mode == 1;
+        exact_evaluator evaluator(rational);
+        evaluator.evaluate(pool);
+        long long counts[4] = {0, 0, 0, 0}, conservative = 0;
+        // Every node is the root of a subtree, so check them all
+        for (uint32_t i = 0; i < pool.size(); i++)
+        {
+            reference_value want = reference(pool, i, rational);
+            exact_value got = evaluator.get(i);
+            bool ok;
+            if (got.status == eval_status::overflow && want.status != eval_status::overflow && rational &&
+                want.conservative)
+            {
+                ok = true;
+                conservative++;
+            }
+            else if (got.status != want.status)
+            {
+                ok = false;
+            }
+            else
+            {
+                ok = got.status != eval_status::ok || (got.num == want.num && got.den == want.den);
+            }
+            counts[static_cast<int>(got.status)]++;
+            if (!ok && failures++ < 10)
+            {
+                std::printf("%s mode, node %u: got %s %lld/%lld, want %s %lld/%lld\n", rational ? "rational" : "integer",
+                            i, status_name(got.status), static_cast<long long>(got.num),
+                            static_cast<long long>(got.den), status_name(want.status),
+                            static_cast<long long>(want.num), static_cast<long long>(want.den));
+            }
+        }
+        std::printf("%-8s nodes %u: ok %lld, overflow %lld (conservative %lld), division_by_zero %lld, inexact %lld\n",
+                    rational ? "rational" : "integer", pool.size(), counts[0], counts[1], conservative, counts[2],
+                    counts[3]);
+    }
+
+    // Generated problems: the evaluator agrees with the values the
+    // generator cached, also when evaluating one problem's range at a time
+    problem_set set = generate_problems(seed, 3, 20000, 1, false);
+    exact_evaluator integer(false);
+    for (size_t i = 0; i < set.size(); i++)
+    {
+        integer.evaluate(set.get_pool(), set.get_root(i), set.get_end(i));
+        int64_t value = 0;
+        if (integer.get(set.get_root(i), value) != eval_status::ok || value != set.get_result(i))
+        {
+            if (failures++ < 10)
+                std::printf("problem %zu: evaluator disagrees with the generator\n", i);
+        }
+    }
+
+    std::printf("%s: %lld failures\n", failures ? "FAILED" : "passed", failures);
+    return failures ? 1 : 0;
+}
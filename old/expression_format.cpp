@@ -0,0 +1,137 @@
+// expression_format.cpp
+#pragma once
+#include "expression_format.h"
+#include <cstring>
+#include <vector>
+
+static size_t literal_size(int32_t value)
+{
+    uint32_t magnitude = value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+    size_t size = value < 0 ? 2 : 1;
+    while (magnitude >= 10)
+    {
+        magnitude /= 10;
+        size++;
+    }
+    return size;
+}
+
+static size_t operand_size(const expression_pool &pool, uint32_t child, char op, bool right)
+{
+    const expression_node &node = pool[child];
+    if (node.op == 0)
+    {
+        return literal_size(node.value);
+    }
+    return formatted_size(pool, child) + (needs_parentheses(op, node.op, right) ? 2 : 0);
+}
+
+size_t formatted_size(const expression_pool &pool, uint32_t index)
+{
+    const expression_node &node = pool[index];
+    if (node.op == 0)
+    {
+        return literal_size(node.value);
+    }
+    return operand_size(pool, node.left, node.op, false) + 1 + operand_size(pool, node.right, node.op, true);
+}
+
+// Literals are mostly below 1000: digits of v are digits[v][0..2], their
+// count digits[v][3]. Copying all four bytes and advancing by the count
+// avoids a branch per digit; hence the format_slack bytes.
+struct literal_digits
+{
+    char digits[1000][4];
+    literal_digits()
+    {
+        for (int v = 0; v < 1000; v++)
+        {
+            char *end = std::to_chars(digits[v], digits[v] + 3, v).ptr;
+            digits[v][3] = static_cast<char>(end - digits[v]);
+        }
+    }
+};
+static const literal_digits small_literals;
+
+static char *format_literal(int32_t value, char *out)
+{
+    if (static_cast<uint32_t>(value) < 1000)
+    {
+        const char *digits = small_literals.digits[value];
+        std::memcpy(out, digits, 4);
+        return out + digits[3];
+    }
+    return std::to_chars(out, out + max_chars_per_node, value).ptr;
+}
+
+static char *format_operand(const expression_pool &pool, uint32_t child, char op, bool right, char *out)
+{
+    const expression_node &node = pool[child];
+    if (node.op == 0)
+    {
+        return format_literal(node.value, out);
+    }
+    if (!needs_parentheses(op, node.op, right))
+    {
+        return format_expression(pool, child, out);
+    }
+    *out++ = '(';
+    out = format_expression(pool, child, out);
+    *out++ = ')';
+    return out;
+}
+
+char *format_expression(const expression_pool &pool, uint32_t index, char *out)
+{
+    const expression_node &node = pool[index];
+    if (node.op == 0)
+    {
+        return format_literal(node.value, out);
+    }
+    out = format_operand(pool, node.left, node.op, false, out);
+    *out++ = node.op;
+    return format_operand(pool, node.right, node.op, true, out);
+}
+
+// Problem i of a set occupies get_end(i) - get_root(i) nodes, which bounds
+// its text without walking it; only a problem at the end of the buffer
+// needs its exact size
+size_t format_problems(const problem_set &set, size_t first, size_t last, char *buffer, size_t capacity,
+                       size_t &written, bool answers)
+{
+    const expression_pool &pool = set.get_pool();
+    char *out = buffer;
+    char *end = buffer + capacity;
+    size_t i = first;
+    for (; i < last; i++)
+    {
+        uint32_t root = set.get_root(i);
+        size_t answer = answers ? 1 + max_chars_per_node : 0;
+        size_t bound = (set.get_end(i) - root) * max_chars_per_node + answer + 1 + format_slack;
+        if (static_cast<size_t>(end - out) < bound &&
+            static_cast<size_t>(end - out) < formatted_size(pool, root) + answer + 1 + format_slack)
+        {
+            break;
+        }
+        out = format_expression(pool, root, out);
+        if (answers)
+        {
+            *out++ = '=';
+            out = format_literal(set.get_result(i), out);
+        }
+        *out++ = '\n';
+    }
+    written += out - buffer;
+    return i;
+}
+
+void write_problems(std::ostream &os, const problem_set &set, bool answers)
+{
+    std::vector<char> buffer(1 << 20);
+    for (size_t i = 0; i < set.size();)
+    {
+        size_t written = 0;
+        i = format_problems(set, i, set.size(), buffer.data(), buffer.size(), written, answers);
+        os.write(buffer.data(), written);
+    }
+}
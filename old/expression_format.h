@@ -0,0 +1,39 @@
+//expression_format.h
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include "expression_pool.h"
+#include "problem_set.h"
+
+// Text of a tree without iostreams or temporary strings, with the
+// parentheses of calulation::output(os, parentPriority): a nested operand
+// is parenthesized where needs_parentheses() says so, which keeps the text
+// meaning the stored tree.
+
+// A literal takes at most 11 chars ("-2147483648"), an operator one plus
+// two for the parentheses of its operands; leaves outnumber operators, so
+// a tree of n nodes never needs more than 11 * n chars
+const size_t max_chars_per_node = 11;
+// Writes may run up to format_slack chars past the end of the text
+const size_t format_slack = 3;
+
+// Exact length of the text of the tree at index
+size_t formatted_size(const expression_pool &pool, uint32_t index);
+// Writes the tree at index to out, which must have room for
+// formatted_size() + format_slack chars (or max_chars_per_node per node
+// + format_slack), returns the end of the text
+char *format_expression(const expression_pool &pool, uint32_t index, char *out);
+
+// Formats problems [first, last) of set, one per line, optionally followed
+// by "=answer", into buffer. Stops before the first problem that might not
+// fit; returns the index of the next problem, first if capacity cannot
+// hold even that one, and adds the bytes written to written.
+size_t format_problems(const problem_set &set, size_t first, size_t last, char *buffer, size_t capacity,
+                       size_t &written, bool answers = false);
+// Writes every problem of set to os through one reused buffer
+void write_problems(std::ostream &os, const problem_set &set, bool answers = false);
+
+#include "expression_format.cpp"
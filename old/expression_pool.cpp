@@ -0,0 +1,122 @@
+// expression_pool.cpp
+#pragma once
+#include "expression_pool.h"
+
+int operator_bit(char op)
+{
+    switch (op)
+    {
+    case '+':
+        return 1;
+    case '-':
+        return 2;
+    case '*':
+        return 4;
+    case '/':
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+uint32_t expression_pool::add_leaf(int32_t value)
+{
+    nodes.push_back({value, no_node, no_node, 0});
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+uint32_t expression_pool::add_node()
+{
+    nodes.push_back({0, no_node, no_node, '+'});
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void expression_pool::clear()
+{
+    nodes.clear();
+}
+
+// Drops every node from index count on; the caller must not keep indices into them
+void expression_pool::truncate(uint32_t count)
+{
+    if (count < nodes.size())
+    {
+        nodes.resize(count);
+    }
+}
+
+void expression_pool::reserve(uint32_t count)
+{
+    nodes.reserve(count);
+}
+
+// Keeps the layout random_node relies on: a node first, then its subtree
+uint32_t expression_pool::append_tree(const expression_pool &from, uint32_t index)
+{
+    const expression_node &node = from.nodes[index];
+    if (node.op == 0)
+    {
+        return add_leaf(node.value);
+    }
+    uint32_t copy = add_node();
+    uint32_t left = append_tree(from, node.left);
+    uint32_t right = append_tree(from, node.right);
+    nodes[copy] = {node.value, left, right, node.op};
+    return copy;
+}
+
+uint32_t expression_pool::append(const expression_pool &from)
+{
+    return append(from, 0, from.size());
+}
+
+uint32_t expression_pool::append(const expression_pool &from, uint32_t first, uint32_t last)
+{
+    uint32_t start = size();
+    uint32_t base = start - first;
+    nodes.insert(nodes.end(), from.nodes.begin() + first, from.nodes.begin() + last);
+    for (auto it = nodes.begin() + start; it != nodes.end(); ++it)
+    {
+        if (it->op != 0)
+        {
+            it->left += base;
+            it->right += base;
+        }
+    }
+    return base;
+}
+
+uint32_t expression_pool::size() const
+{
+    return static_cast<uint32_t>(nodes.size());
+}
+
+bool expression_pool::empty() const
+{
+    return nodes.empty();
+}
+
+bool expression_pool::is_leaf(uint32_t index) const
+{
+    return nodes[index].op == 0;
+}
+
+int expression_pool::operator_mask(uint32_t index) const
+{
+    const expression_node &node = nodes[index];
+    if (node.op == 0)
+    {
+        return 0;
+    }
+    return operator_bit(node.op) | operator_mask(node.left) | operator_mask(node.right);
+}
+
+expression_node &expression_pool::operator[](uint32_t index)
+{
+    return nodes[index];
+}
+
+const expression_node &expression_pool::operator[](uint32_t index) const
+{
+    return nodes[index];
+}
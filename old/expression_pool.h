@@ -0,0 +1,52 @@
+//expression_pool.h
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// One node of an expression tree. op == 0 marks a literal, whose value is the
+// number itself; otherwise value caches the result of left op right.
+struct expression_node
+{
+    int32_t value;
+    uint32_t left;
+    uint32_t right;
+    char op;
+};
+
+const uint32_t no_node = UINT32_MAX;
+
+// Operator masks: bit 0 '+', 1 '-', 2 '*', 3 '/'; 0 for anything else
+int operator_bit(char op);
+
+// Nodes of a tree live contiguously and refer to their children by index.
+// clear() and truncate() keep the capacity, so regenerating a tree of the
+// same size does not allocate.
+class expression_pool
+{
+public:
+    uint32_t add_leaf(int32_t value);
+    uint32_t add_node();
+    void clear();
+    void truncate(uint32_t count);
+    void reserve(uint32_t count);
+    // Copies the subtree at index in from, returns the index of its copy
+    uint32_t append_tree(const expression_pool &from, uint32_t index);
+    // Appends every node of from, returns the offset added to its indices
+    uint32_t append(const expression_pool &from);
+    // Appends nodes [first, last) of from, which must hold whole subtrees;
+    // returns the offset added to their indices
+    uint32_t append(const expression_pool &from, uint32_t first, uint32_t last);
+    uint32_t size() const;
+    bool empty() const;
+    bool is_leaf(uint32_t index) const;
+    // Operators used in the tree at index, as an operator mask
+    int operator_mask(uint32_t index) const;
+    expression_node &operator[](uint32_t index);
+    const expression_node &operator[](uint32_t index) const;
+
+private:
+    std::vector<expression_node> nodes;
+};
+
+#include "expression_pool.cpp"
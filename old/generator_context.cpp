@@ -0,0 +1,104 @@
+// generator_context.cpp
+#pragma once
+#include "generator_context.h"
+
+uint64_t splitmix64(uint64_t &state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+xoshiro256::xoshiro256(uint64_t seed)
+{
+    this->seed(seed);
+}
+
+void xoshiro256::seed(uint64_t seed)
+{
+    for (uint64_t &word : s)
+    {
+        word = splitmix64(seed);
+    }
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+uint64_t xoshiro256::next()
+{
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+// Lemire's multiply-shift, retrying only in the biased low slice
+uint32_t xoshiro256::below(uint32_t n)
+{
+    uint64_t m = (next() >> 32) * n;
+    uint32_t low = static_cast<uint32_t>(m);
+    if (low < n)
+    {
+        uint32_t threshold = (0u - n) % n;
+        while (low < threshold)
+        {
+            m = (next() >> 32) * n;
+            low = static_cast<uint32_t>(m);
+        }
+    }
+    return static_cast<uint32_t>(m >> 32);
+}
+
+generator_context::generator_context(uint64_t seed, long difficulty) : rng(seed)
+{
+    mems = 1;
+    max_member = ::max_member;
+    constructive = false;
+    for (uint16_t &weight : op_weights)
+    {
+        weight = 0;
+    }
+    set_difficulty(difficulty);
+}
+
+void generator_context::seed(uint64_t seed)
+{
+    rng.seed(seed);
+}
+
+void generator_context::set_difficulty(long difficulty)
+{
+    get_difficulty_params(difficulty, current_chance, max_value);
+    // random(long) bounds nested expressions by the level they map back to
+    child_max = (difficulty < 1 || difficulty > 5) ? 3 : static_cast<int>(difficulty);
+}
+
+int generator_context::draw(int n)
+{
+    return static_cast<int>(rng.below(static_cast<uint32_t>(n)));
+}
+
+int generator_context::draw_op()
+{
+    int total = op_weights[0] + op_weights[1] + op_weights[2] + op_weights[3];
+    if (total == 0)
+    {
+        return draw(4);
+    }
+    int pick = draw(total);
+    int op = 0;
+    while (pick >= op_weights[op])
+    {
+        pick -= op_weights[op++];
+    }
+    return op;
+}
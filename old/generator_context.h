@@ -0,0 +1,52 @@
+//generator_context.h
+#pragma once
+
+#include <cstdint>
+
+// xoshiro256** seeded through splitmix64
+class xoshiro256
+{
+public:
+    explicit xoshiro256(uint64_t seed = 0);
+    void seed(uint64_t seed);
+    uint64_t next();
+    // Uniform in [0, n), without modulo bias
+    uint32_t below(uint32_t n);
+
+private:
+    uint64_t s[4];
+};
+
+// Nested expressions one problem may create; the default nesting budget
+const short max_member = 10;
+
+uint64_t splitmix64(uint64_t &state);
+void get_difficulty_params(int difficulty, int &current_chance, int &max_value);
+
+// Everything one generator thread needs instead of rand(), the global mems
+// counter and the global calulation: a private PRNG, the nesting budget and
+// the difficulty parameters. One context per thread.
+class generator_context
+{
+public:
+    explicit generator_context(uint64_t seed, long difficulty = 3);
+    void seed(uint64_t seed);
+    // Same parameters as calulation::random(long difficulty)
+    void set_difficulty(long difficulty);
+    int draw(int n);
+    // Index into "+-*/" drawn by op_weights
+    int draw_op();
+
+    int current_chance;
+    int max_value;
+    int child_max;      // bound for nested results, 0 = max_target only
+    int mems;           // nested expressions created so far in this problem
+    int max_member;     // mems budget, defaults to max_member
+    bool constructive;  // build '/' from quotient and divisor, no rejection loops
+    uint16_t op_weights[4]; // relative weights of + - * /, all 0 = uniform
+
+private:
+    xoshiro256 rng;
+};
+
+#include "generator_context.cpp"
@@ -0,0 +1,390 @@
+// problem_bank.cpp
+#pragma once
+#include "problem_bank.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char bank_magic[8] = {'C', 'A', 'L', 'C', 'B', 'A', 'N', 'K'};
+
+int bank_answer_range(int answer)
+{
+    if (answer < 0)
+        return 0;
+    if (answer < 10)
+        return 1;
+    if (answer < 100)
+        return 2;
+    return 3;
+}
+
+int bank_key(int difficulty, int ops, int answer_range)
+{
+    return ((difficulty - 1) * bank_op_masks + ops) * bank_answer_ranges + answer_range;
+}
+
+bool make_bank_record(const expression_pool &pool, uint32_t index, bank_record &record)
+{
+    std::memset(&record, 0, sizeof(record));
+    record.answer = static_cast<int16_t>(pool[index].value);
+    // A preorder walk with an explicit stack, right child pushed first
+    uint32_t stack[bank_max_nodes];
+    int depth = 0, literals = 0;
+    stack[depth++] = index;
+    while (depth > 0)
+    {
+        if (record.nodes == bank_max_nodes)
+            return false;
+        const expression_node &node = pool[stack[--depth]];
+        record.shape[record.nodes++] = node.op;
+        if (node.op == 0)
+        {
+            if (literals == bank_max_literals || node.value < INT16_MIN || node.value > INT16_MAX)
+                return false;
+            record.literals[literals++] = static_cast<int16_t>(node.value);
+            continue;
+        }
+        record.ops |= operator_bit(node.op);
+        if (depth + 2 > bank_max_nodes)
+            return false;
+        stack[depth++] = node.right;
+        stack[depth++] = node.left;
+    }
+    // A truncating division or an overflowing value would be rejected by
+    // problem_bank::open, so such a tree is not written at all
+    return pool[index].value >= INT16_MIN && pool[index].value <= INT16_MAX && valid_bank_record(record);
+}
+
+// Walks the preorder shape bottom-up like load_bank_record: a literal
+// pushes its value, an operator pops its two operands, one value is left
+bool valid_bank_record(const bank_record &record)
+{
+    if (record.nodes < 1 || record.nodes > bank_max_nodes)
+        return false;
+    int64_t stack[bank_max_nodes];
+    int depth = 0, literals = 0, ops = 0;
+    for (int i = 0; i < record.nodes; i++)
+    {
+        if (record.shape[i] == 0)
+            literals++;
+        else if (operator_bit(record.shape[i]) == 0)
+            return false;
+    }
+    if (literals > bank_max_literals)
+        return false;
+    for (int i = record.nodes - 1; i >= 0; i--)
+    {
+        char op = record.shape[i];
+        if (op == 0)
+        {
+            stack[depth++] = record.literals[--literals];
+            continue;
+        }
+        if (depth < 2)
+            return false;
+        int64_t l = stack[--depth], r = stack[--depth], value;
+        switch (op)
+        {
+        case '+':
+            value = l + r;
+            break;
+        case '-':
+            value = l - r;
+            break;
+        case '*':
+            value = l * r;
+            break;
+        default:
+            if (r == 0 || l % r != 0)
+                return false;
+            value = l / r;
+            break;
+        }
+        if (value < INT32_MIN || value > INT32_MAX)
+            return false;
+        ops |= operator_bit(op);
+        stack[depth++] = value;
+    }
+    return depth == 1 && stack[0] == record.answer && ops == record.ops;
+}
+
+// Node values of operators are recomputed bottom-up, children come after
+// their parent in preorder
+uint32_t load_bank_record(const bank_record &record, expression_pool &pool)
+{
+    pool.clear();
+    uint32_t stack[bank_max_nodes];
+    int depth = 0, literals = 0;
+    for (int i = 0; i < record.nodes; i++)
+    {
+        if (record.shape[i] == 0)
+            pool.add_leaf(record.literals[literals++]);
+        else
+            pool.add_node();
+    }
+    for (int i = record.nodes - 1; i >= 0; i--)
+    {
+        expression_node &node = pool[i];
+        if (record.shape[i] == 0)
+        {
+            stack[depth++] = i;
+            continue;
+        }
+        node.op = record.shape[i];
+        node.left = stack[--depth];
+        node.right = stack[--depth];
+        int32_t l = pool[node.left].value, r = pool[node.right].value;
+        switch (node.op)
+        {
+        case '+':
+            node.value = l + r;
+            break;
+        case '-':
+            node.value = l - r;
+            break;
+        case '*':
+            node.value = l * r;
+            break;
+        default:
+            node.value = r != 0 ? l / r : 0;
+            break;
+        }
+        stack[depth++] = i;
+    }
+    return 0;
+}
+
+size_t write_problem_bank(const std::string &path, const problem_set *sets)
+{
+    std::vector<bank_record> records;
+    std::vector<uint16_t> keys;
+    std::vector<uint64_t> first(bank_keys + 1, 0);
+    for (int d = 1; d <= bank_difficulties; d++)
+    {
+        const problem_set &set = sets[d - 1];
+        for (size_t i = 0; i < set.size(); i++)
+        {
+            bank_record record;
+            if (!make_bank_record(set.get_pool(), set.get_root(i), record))
+                continue;
+            uint16_t key = static_cast<uint16_t>(bank_key(d, record.ops, bank_answer_range(record.answer)));
+            records.push_back(record);
+            keys.push_back(key);
+            first[key + 1]++;
+        }
+    }
+    // Counting sort by key, stable within a key
+    for (int key = 0; key < bank_keys; key++)
+        first[key + 1] += first[key];
+    std::vector<bank_record> sorted(records.size());
+    std::vector<uint64_t> next(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < records.size(); i++)
+        sorted[next[keys[i]]++] = records[i];
+
+    bank_header header{};
+    std::memcpy(header.magic, bank_magic, sizeof(header.magic));
+    header.version = 1;
+    header.record_size = sizeof(bank_record);
+    header.record_count = sorted.size();
+    header.records_offset = (sizeof(header) + first.size() * sizeof(uint64_t) + 63) & ~uint64_t{63};
+    header.key_count = bank_keys;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("cannot write problem bank: " + path);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(first.data()), first.size() * sizeof(uint64_t));
+    std::vector<char> padding(header.records_offset - sizeof(header) - first.size() * sizeof(uint64_t), 0);
+    out.write(padding.data(), padding.size());
+    out.write(reinterpret_cast<const char *>(sorted.data()), sorted.size() * sizeof(bank_record));
+    if (!out)
+        throw std::runtime_error("cannot write problem bank: " + path);
+    return sorted.size();
+}
+
+problem_bank::problem_bank() : data(nullptr), length(0), first(nullptr), records(nullptr), records_count(0)
+{
+}
+
+problem_bank::problem_bank(const std::string &path) : problem_bank()
+{
+    open(path);
+}
+
+problem_bank::~problem_bank()
+{
+    close();
+}
+
+void problem_bank::open(const std::string &path)
+{
+    close();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("cannot open problem bank: " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(bank_header)))
+    {
+        ::close(fd);
+        throw std::runtime_error("not a problem bank: " + path);
+    }
+    length = static_cast<size_t>(st.st_size);
+    // Prefault the pages so that draws never take a page fault
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    void *mapped = ::mmap(nullptr, length, PROT_READ, flags, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        length = 0;
+        throw std::runtime_error("cannot map problem bank: " + path);
+    }
+    data = static_cast<const char *>(mapped);
+#else
+    // Without mmap the bank is read into memory once
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        throw std::runtime_error("cannot open problem bank: " + path);
+    length = static_cast<size_t>(in.tellg());
+    char *buffer = new char[length];
+    in.seekg(0);
+    in.read(buffer, static_cast<std::streamsize>(length));
+    data = buffer;
+#endif
+
+    bank_header header;
+    size_t table_end = sizeof(header) + (bank_keys + 1) * sizeof(uint64_t);
+    if (length < table_end)
+    {
+        close();
+        throw std::runtime_error("not a problem bank: " + path);
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, bank_magic, sizeof(header.magic)) != 0 ||
+        header.version != 1 || header.record_size != sizeof(bank_record) || header.key_count != bank_keys ||
+        header.records_offset < table_end || header.records_offset > length ||
+        header.records_offset % alignof(bank_record) != 0 ||
+        header.record_count > (length - header.records_offset) / sizeof(bank_record))
+    {
+        close();
+        throw std::runtime_error("not a problem bank: " + path);
+    }
+    first = reinterpret_cast<const uint64_t *>(data + sizeof(header));
+    records = reinterpret_cast<const bank_record *>(data + header.records_offset);
+    records_count = header.record_count;
+    if (first[0] != 0 || first[bank_keys] != records_count ||
+        !std::is_sorted(first, first + bank_keys + 1))
+    {
+        close();
+        throw std::runtime_error("corrupt problem bank: " + path);
+    }
+    // Every record is checked once here, so that draw() and
+    // load_bank_record() can trust them
+    for (int key = 0; key < bank_keys; key++)
+    {
+        int difficulty = key / (bank_op_masks * bank_answer_ranges) + 1;
+        for (uint64_t i = first[key]; i < first[key + 1]; i++)
+        {
+            const bank_record &record = records[i];
+            if (!valid_bank_record(record) ||
+                bank_key(difficulty, record.ops, bank_answer_range(record.answer)) != key)
+            {
+                close();
+                throw std::runtime_error("corrupt problem bank: " + path + " (record " + std::to_string(i) + ")");
+            }
+        }
+    }
+    for (int d = 1; d <= bank_difficulties; d++)
+    {
+        for (int range = 0; range < bank_answer_ranges; range++)
+        {
+            uint64_t *counts = below[d - 1][range];
+            counts[0] = 0;
+            for (int mask = 0; mask < bank_op_masks; mask++)
+            {
+                int key = bank_key(d, mask, range);
+                counts[mask + 1] = counts[mask] + first[key + 1] - first[key];
+            }
+        }
+    }
+}
+
+void problem_bank::close()
+{
+    if (data)
+    {
+#ifndef _WIN32
+        ::munmap(const_cast<char *>(data), length);
+#else
+        delete[] data;
+#endif
+    }
+    data = nullptr;
+    length = 0;
+    first = nullptr;
+    records = nullptr;
+    records_count = 0;
+}
+
+bool problem_bank::is_open() const
+{
+    return data != nullptr;
+}
+
+size_t problem_bank::size() const
+{
+    return records_count;
+}
+
+size_t problem_bank::count(int difficulty, int ops, int answer_range) const
+{
+    if (!data || difficulty < 1 || difficulty > bank_difficulties || ops < 0 || ops >= bank_op_masks ||
+        answer_range < any_answer || answer_range >= bank_answer_ranges)
+        return 0;
+    if (answer_range != any_answer && ops != any_ops)
+    {
+        int key = bank_key(difficulty, ops, answer_range);
+        return first[key + 1] - first[key];
+    }
+    if (answer_range == any_answer)
+    {
+        int key = bank_key(difficulty, ops, 0);
+        int keys = ops == any_ops ? bank_op_masks * bank_answer_ranges : bank_answer_ranges;
+        return first[key + keys] - first[key];
+    }
+    return below[difficulty - 1][answer_range][bank_op_masks];
+}
+
+// Records of one difficulty, or of one difficulty and operator mask, are
+// contiguous; "any operators in one answer range" spans 16 keys, found by
+// counting the prefix sums in below not above the pick
+const bank_record *problem_bank::draw(xoshiro256 &rng, int difficulty, int ops, int answer_range) const
+{
+    size_t total = count(difficulty, ops, answer_range);
+    if (total == 0)
+        return nullptr;
+    uint64_t pick = static_cast<uint64_t>(total) <= UINT32_MAX ? rng.below(static_cast<uint32_t>(total))
+                                                               : rng.next() % total;
+    if (ops == any_ops && answer_range != any_answer)
+    {
+        const uint64_t *counts = below[difficulty - 1][answer_range];
+        int mask = -1;
+        for (int m = 0; m <= bank_op_masks; m++)
+            mask += counts[m] <= pick;
+        return records + first[bank_key(difficulty, mask, answer_range)] + (pick - counts[mask]);
+    }
+    int key = bank_key(difficulty, ops, answer_range == any_answer ? 0 : answer_range);
+    return records + first[key] + pick;
+}
@@ -0,0 +1,103 @@
+//problem_bank.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "problem_set.h"
+#include "expression_pool.h"
+#include "generator_context.h"
+
+// On-disk bank of pregenerated problems. Records have a fixed size and are
+// sorted by key (difficulty, operator mix, answer range); a table of first
+// record per key makes drawing a problem O(1). The file is mapped read-only
+// and used in place, little-endian.
+//
+// file: bank_header | uint64_t first[bank_keys + 1] | records from
+// header.records_offset
+
+const int bank_difficulties = 5;
+const int bank_op_masks = 16;   // operator masks, see operator_bit()
+const int bank_answer_ranges = 4;
+const int bank_keys = bank_difficulties * bank_op_masks * bank_answer_ranges;
+const int any_ops = 0;          // draw(): no constraint on operators
+const int any_answer = -1;      // draw(): no constraint on the answer
+
+// A tree in preorder: shape[i] is the op of node i, 0 for a literal, and
+// literals[] the values of the literals in order. Covers the trees of
+// max_member nested expressions: at most 10 operators and 11 literals.
+const int bank_max_nodes = 21;
+const int bank_max_literals = 11;
+struct bank_record
+{
+    int16_t answer;
+    uint8_t nodes;
+    uint8_t ops;
+    int16_t literals[bank_max_literals];
+    char shape[bank_max_nodes + 1];
+};
+static_assert(sizeof(bank_record) == 48, "bank_record layout is part of the file format");
+
+struct bank_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t record_count;
+    uint64_t records_offset;
+    uint32_t key_count;
+    uint32_t reserved;
+};
+
+// 0: negative, 1: 0-9, 2: 10-99, 3: 100 and up
+int bank_answer_range(int answer);
+int bank_key(int difficulty, int ops, int answer_range);
+
+// Packs the tree at index; false if it does not fit a record
+bool make_bank_record(const expression_pool &pool, uint32_t index, bank_record &record);
+// Whether record holds a well-formed tree: 1 to bank_max_nodes nodes of
+// '+', '-', '*', '/' and literals in a valid preorder, every value an int32
+// and every division exact, answer and ops matching the tree
+bool valid_bank_record(const bank_record &record);
+// Clears pool and unpacks record into it, returns the root. record must be
+// valid, as every record of an open problem_bank is. Reusing one pool keeps
+// this free of allocations after the first call.
+uint32_t load_bank_record(const bank_record &record, expression_pool &pool);
+
+// Writes sets[d - 1] as the problems of difficulty d; problems that do not
+// fit a record are skipped. Returns the number of records written, throws
+// std::runtime_error if path cannot be written.
+size_t write_problem_bank(const std::string &path, const problem_set *sets);
+
+class problem_bank
+{
+public:
+    problem_bank();
+    // Throws std::runtime_error if path is missing, not a bank or holds a
+    // record that is not valid_bank_record() or not under its key
+    explicit problem_bank(const std::string &path);
+    ~problem_bank();
+    problem_bank(const problem_bank &) = delete;
+    problem_bank &operator=(const problem_bank &) = delete;
+
+    void open(const std::string &path);
+    void close();
+    bool is_open() const;
+    size_t size() const;
+    size_t count(int difficulty, int ops = any_ops, int answer_range = any_answer) const;
+    // Uniform among the records matching; ops is an exact operator mask.
+    // nullptr if none match.
+    const bank_record *draw(xoshiro256 &rng, int difficulty, int ops = any_ops, int answer_range = any_answer) const;
+
+private:
+    const char *data;
+    size_t length;
+    const uint64_t *first;
+    const bank_record *records;
+    size_t records_count;
+    // below[d - 1][range][m]: records of difficulty d and answer range
+    // range whose operator mask is below m
+    uint64_t below[bank_difficulties][bank_answer_ranges][bank_op_masks + 1];
+};
+
+#include "problem_bank.cpp"
@@ -0,0 +1,143 @@
+//problem_bank_check.cpp
+// Checks that problem_bank::open accepts a bank written by
+// write_problem_bank and rejects truncated files and corrupt records
+// g++ -std=c++17 -O2 problem_bank_check.cpp -o problem_bank_check -pthread
+// problem_bank_check [directory]
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "problem_bank.h"
+
+int consoleWidth, consoleHeight;
+int mems;
+
+static std::vector<char> read_file(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string &path, const std::vector<char> &data, size_t size)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(size));
+}
+
+static bool opens(const std::string &path)
+{
+    try
+    {
+        problem_bank bank(path);
+        return true;
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string directory = argc > 1 ? argv[1] : ".";
+    std::string path = directory + "/problem_bank_check.bin";
+    std::string broken = directory + "/problem_bank_check.bad";
+
+    problem_set sets[bank_difficulties];
+    for (int d = 1; d <= bank_difficulties; d++)
+        sets[d - 1] = generate_problems(d, d, 2000, 1, true);
+    size_t written = write_problem_bank(path, sets);
+
+    int failures = 0;
+    auto expect = [&](bool ok, const char *what) {
+        if (!ok)
+        {
+            std::printf("FAILED: %s\n", what);
+            failures++;
+        }
+    };
+
+    expect(opens(path), "a written bank opens");
+    std::vector<char> data = read_file(path);
+    bank_header header;
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    // Truncated files: inside the header, the key table and the records
+    for (size_t size : {sizeof(bank_header) - 1, sizeof(bank_header) + 8, static_cast<size_t>(header.records_offset) + 1,
+                        data.size() - 1})
+    {
+        write_file(broken, data, size);
+        expect(!opens(broken), "a truncated bank is rejected");
+    }
+
+    // Corrupt records: each case damages one field of a record in the
+    // middle of the file and must be rejected
+    size_t target = written / 2;
+    size_t offset = header.records_offset + target * sizeof(bank_record);
+    bank_record original;
+    std::memcpy(&original, data.data() + offset, sizeof(original));
+    auto corrupt = [&](const char *what, auto damage) {
+        bank_record record = original;
+        damage(record);
+        std::vector<char> copy = data;
+        std::memcpy(copy.data() + offset, &record, sizeof(record));
+        write_file(broken, copy, copy.size());
+        expect(!opens(broken), what);
+    };
+    corrupt("no nodes", [](bank_record &r) { r.nodes = 0; });
+    corrupt("more nodes than bank_max_nodes", [](bank_record &r) { r.nodes = 255; });
+    corrupt("an operator outside +-*/", [](bank_record &r) { r.shape[0] = '%'; });
+    corrupt("an operator without operands", [](bank_record &r) {
+        std::memset(r.shape, '+', sizeof(r.shape));
+        r.nodes = bank_max_nodes;
+    });
+    corrupt("literals left over", [](bank_record &r) {
+        std::memset(r.shape, 0, sizeof(r.shape));
+        r.nodes = 3;
+    });
+    corrupt("more literals than bank_max_literals", [](bank_record &r) {
+        r.nodes = bank_max_nodes;
+        std::memset(r.shape, 0, sizeof(r.shape));
+        for (int i = 0; i < 9; i++)
+            r.shape[i] = '+';
+    });
+    corrupt("a wrong answer", [](bank_record &r) { r.answer++; });
+    corrupt("a wrong operator mask", [](bank_record &r) { r.ops ^= 1; });
+    corrupt("a literal changed", [](bank_record &r) { r.literals[0] ^= 0x4000; });
+    corrupt("a division by zero", [](bank_record &r) {
+        r.nodes = 3;
+        r.shape[0] = '/';
+        r.shape[1] = r.shape[2] = 0;
+        r.literals[0] = 6;
+        r.literals[1] = 0;
+        r.ops = operator_bit('/');
+    });
+
+    // Every bit of the record: a flip is either rejected or leaves a
+    // record that still loads to its own answer
+    for (size_t bit = 0; bit < sizeof(bank_record) * 8; bit++)
+    {
+        std::vector<char> copy = data;
+        copy[offset + bit / 8] ^= static_cast<char>(1 << (bit % 8));
+        write_file(broken, copy, copy.size());
+        try
+        {
+            problem_bank bank(broken);
+            bank_record record;
+            std::memcpy(&record, copy.data() + offset, sizeof(record));
+            expression_pool pool;
+            uint32_t root = load_bank_record(record, pool);
+            expect(pool[root].value == record.answer, "an accepted record loads to its answer");
+        }
+        catch (const std::exception &)
+        {
+        }
+    }
+
+    std::remove(path.c_str());
+    std::remove(broken.c_str());
+    std::printf("%zu records, %s: %d failures\n", written, failures ? "FAILED" : "passed", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+// problem_hash.cpp
+#pragma once
+#include "problem_hash.h"
+#include <algorithm>
+
+// splitmix64 finalizer
+static inline uint64_t mix64(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t node_hash(const expression_pool &pool, uint32_t index)
+{
+    const expression_node &node = pool[index];
+    if (node.op == 0)
+    {
+        return mix64(static_cast<uint32_t>(node.value) ^ 0x9e3779b97f4a7c15ULL);
+    }
+    uint64_t left = node_hash(pool, node.left);
+    uint64_t right = node_hash(pool, node.right);
+    if ((node.op == '+' || node.op == '*') && right < left)
+    {
+        uint64_t t = left;
+        left = right;
+        right = t;
+    }
+    // Rotating the left hash keeps a op b apart from b op a
+    return mix64(((left << 23) | (left >> 41)) ^ right ^ (static_cast<uint64_t>(node.op) << 56));
+}
+
+uint64_t canonical_hash(const expression_pool &pool, uint32_t index)
+{
+    uint64_t hash = node_hash(pool, index);
+    return hash != 0 ? hash : 1;
+}
+
+static size_t power_of_two_at_least(size_t n)
+{
+    size_t p = 64;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+bloom_filter::bloom_filter(size_t expected, unsigned bits_per_entry)
+{
+    size_t words = power_of_two_at_least(expected * bits_per_entry) / 64;
+    bits.assign(words, 0);
+    mask = words * 64 - 1;
+    probes = bits_per_entry * 7 / 10; // about ln 2 * bits per entry
+    if (probes == 0)
+        probes = 1;
+}
+
+// Probe i is at h1 + i * h2 (Kirsch-Mitzenmacher)
+void bloom_filter::insert(uint64_t hash)
+{
+    uint64_t h1 = hash, h2 = (hash >> 32) | 1;
+    for (unsigned i = 0; i < probes; i++)
+    {
+        uint64_t bit = (h1 + i * h2) & mask;
+        bits[bit >> 6] |= 1ULL << (bit & 63);
+    }
+}
+
+bool bloom_filter::maybe_contains(uint64_t hash) const
+{
+    uint64_t h1 = hash, h2 = (hash >> 32) | 1;
+    for (unsigned i = 0; i < probes; i++)
+    {
+        uint64_t bit = (h1 + i * h2) & mask;
+        if ((bits[bit >> 6] & (1ULL << (bit & 63))) == 0)
+            return false;
+    }
+    return true;
+}
+
+void bloom_filter::clear()
+{
+    std::fill(bits.begin(), bits.end(), 0);
+}
+
+hash_table::hash_table(size_t expected) : slots(power_of_two_at_least(2 * expected), 0), count(0)
+{
+}
+
+bool hash_table::insert(uint64_t hash)
+{
+    if (2 * (count + 1) > slots.size())
+        grow();
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        if (slots[i] == hash)
+            return false;
+        if (slots[i] == 0)
+        {
+            slots[i] = hash;
+            count++;
+            return true;
+        }
+    }
+}
+
+bool hash_table::contains(uint64_t hash) const
+{
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        if (slots[i] == hash)
+            return true;
+        if (slots[i] == 0)
+            return false;
+    }
+}
+
+void hash_table::grow()
+{
+    std::vector<uint64_t> old(slots.size() * 2, 0);
+    old.swap(slots);
+    count = 0;
+    for (uint64_t hash : old)
+    {
+        if (hash != 0)
+            insert(hash);
+    }
+}
+
+size_t hash_table::size() const
+{
+    return count;
+}
+
+void hash_table::clear()
+{
+    std::fill(slots.begin(), slots.end(), 0);
+    count = 0;
+}
+
+dedupe_set::dedupe_set(size_t expected, size_t history) : history(history), current(expected)
+{
+    added.reserve(expected);
+}
+
+bool dedupe_set::insert(uint64_t hash)
+{
+    if (history.maybe_contains(hash) || !current.insert(hash))
+        return false;
+    added.push_back(hash);
+    return true;
+}
+
+bool dedupe_set::contains(uint64_t hash) const
+{
+    return current.contains(hash) || history.maybe_contains(hash);
+}
+
+void dedupe_set::add_history(uint64_t hash)
+{
+    history.insert(hash);
+}
+
+void dedupe_set::commit()
+{
+    for (uint64_t hash : added)
+        history.insert(hash);
+    added.clear();
+    current.clear();
+}
+
+size_t dedupe_set::size() const
+{
+    return current.size();
+}
+
+void dedupe_set::clear()
+{
+    history.clear();
+    current.clear();
+    added.clear();
+}
@@ -0,0 +1,74 @@
+//problem_hash.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "expression_pool.h"
+
+// Structural hash of the tree at index: literals by value, operators by
+// op and children. The operands of '+' and '*' are hashed in sorted order,
+// so 3+4 and 4+3 hash alike; 3-4 and 4-3 do not. Associativity is not
+// normalized, (1+2)+3 and 1+(2+3) are different problems.
+// Never returns 0, which the tables below use as the empty slot.
+uint64_t canonical_hash(const expression_pool &pool, uint32_t index);
+
+// Bits per entry 10 and 7 probes give about 1% false positives
+class bloom_filter
+{
+public:
+    explicit bloom_filter(size_t expected = 1024, unsigned bits_per_entry = 10);
+    void insert(uint64_t hash);
+    bool maybe_contains(uint64_t hash) const;
+    void clear();
+
+private:
+    std::vector<uint64_t> bits;
+    uint64_t mask;
+    unsigned probes;
+};
+
+// Open addressing set of canonical hashes, linear probing, kept at most
+// half full. Exact up to 64-bit hash collisions.
+class hash_table
+{
+public:
+    explicit hash_table(size_t expected = 1024);
+    // Returns false if hash was already present
+    bool insert(uint64_t hash);
+    bool contains(uint64_t hash) const;
+    size_t size() const;
+    void clear();
+
+private:
+    void grow();
+    std::vector<uint64_t> slots;
+    size_t count;
+};
+
+// Problems a student must not see again. The current sheet or stream is
+// kept exactly in a hash_table; earlier sheets are folded into a Bloom
+// filter at about 10 bits per problem. A false positive of the filter only
+// rejects a new problem, it never lets a repeat through.
+class dedupe_set
+{
+public:
+    explicit dedupe_set(size_t expected = 1024, size_t history = 1 << 16);
+    // Returns true if hash is new, and records it
+    bool insert(uint64_t hash);
+    bool contains(uint64_t hash) const;
+    // Adds a problem given before, e.g. loaded from the student's record
+    void add_history(uint64_t hash);
+    // Ends the sheet: its problems move into the history filter
+    void commit();
+    // Problems recorded since the last commit
+    size_t size() const;
+    void clear();
+
+private:
+    bloom_filter history;
+    hash_table current;
+    std::vector<uint64_t> added;
+};
+
+#include "problem_hash.cpp"
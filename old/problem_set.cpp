@@ -0,0 +1,143 @@
+// problem_set.cpp
+#pragma once
+#include "problem_set.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+void problem_set::add(const calulation &c)
+{
+    roots.push_back(pool.append_tree(c.get_pool(), c.get_root()));
+    hashes.push_back(c.get_hash());
+}
+
+void problem_set::add(const problem_set &other, size_t i)
+{
+    roots.push_back(other.roots[i] + pool.append(other.pool, other.roots[i], other.get_end(i)));
+    hashes.push_back(other.hashes[i]);
+}
+
+void problem_set::append(const problem_set &other)
+{
+    uint32_t base = pool.append(other.pool);
+    for (uint32_t root : other.roots)
+    {
+        roots.push_back(root + base);
+    }
+    hashes.insert(hashes.end(), other.hashes.begin(), other.hashes.end());
+}
+
+void problem_set::clear()
+{
+    pool.clear();
+    roots.clear();
+    hashes.clear();
+}
+
+size_t problem_set::size() const
+{
+    return roots.size();
+}
+
+int problem_set::get_result(size_t i) const
+{
+    return pool[roots[i]].value;
+}
+
+uint32_t problem_set::get_root(size_t i) const
+{
+    return roots[i];
+}
+
+uint32_t problem_set::get_end(size_t i) const
+{
+    return i + 1 < roots.size() ? roots[i + 1] : pool.size();
+}
+
+const expression_pool &problem_set::get_pool() const
+{
+    return pool;
+}
+
+uint64_t problem_set::get_hash(size_t i) const
+{
+    return hashes[i];
+}
+
+void problem_set::get(size_t i, calulation &c) const
+{
+    c.assign(pool, roots[i]);
+}
+
+problem_set generate_problems(uint64_t seed, long difficulty, size_t count, unsigned threads, bool constructive)
+{
+    size_t chunks = (count + batch_chunk - 1) / batch_chunk;
+    std::vector<problem_set> parts(chunks);
+    std::atomic<size_t> next{0};
+
+    auto worker = [&]()
+    {
+        calulation c;
+        generator_context ctx(0, difficulty);
+        ctx.constructive = constructive;
+        for (size_t k = next++; k < chunks; k = next++)
+        {
+            uint64_t state = seed + k * 0xd1b54a32d192ed03ULL;
+            ctx.seed(splitmix64(state));
+            size_t n = std::min(batch_chunk, count - k * batch_chunk);
+            for (size_t i = 0; i < n; i++)
+            {
+                c.random(ctx);
+                parts[k].add(c);
+            }
+        }
+    };
+
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(chunks, 1)));
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : pool)
+    {
+        t.join();
+    }
+
+    problem_set out;
+    for (auto &part : parts)
+    {
+        out.append(part);
+        part = problem_set();
+    }
+    return out;
+}
+
+problem_set generate_unique_problems(uint64_t seed, long difficulty, size_t count, dedupe_set &seen,
+                                     unsigned threads, bool constructive)
+{
+    problem_set out;
+    for (uint64_t round = 0; out.size() < count; round++)
+    {
+        size_t before = out.size();
+        problem_set candidates = generate_problems(seed + round * 0x9e3779b97f4a7c15ULL, difficulty,
+                                                   std::max<size_t>(count - out.size(), 64), threads, constructive);
+        for (size_t i = 0; i < candidates.size() && out.size() < count; i++)
+        {
+            if (seen.insert(candidates.get_hash(i)))
+            {
+                out.add(candidates, i);
+            }
+        }
+        if (out.size() == before)
+        {
+            break;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,48 @@
+//problem_set.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "caculator.h"
+
+// Many problems sharing one node pool; problem i is the tree at roots[i],
+// stored in preorder (node, left subtree, right subtree)
+class problem_set
+{
+public:
+    void add(const calulation &c);
+    // Copies problem i of other
+    void add(const problem_set &other, size_t i);
+    void append(const problem_set &other);
+    void clear();
+    size_t size() const;
+    int get_result(size_t i) const;
+    uint32_t get_root(size_t i) const;
+    // Problem i occupies nodes [get_root(i), get_end(i)) of the pool
+    uint32_t get_end(size_t i) const;
+    const expression_pool &get_pool() const;
+    // Canonical hash of problem i, computed when it was added
+    uint64_t get_hash(size_t i) const;
+    // Loads problem i into c, e.g. to print it
+    void get(size_t i, calulation &c) const;
+
+private:
+    expression_pool pool;
+    std::vector<uint32_t> roots;
+    std::vector<uint64_t> hashes;
+};
+
+// Problems are generated in chunks of batch_chunk, chunk k seeded from
+// (seed, k), so the result depends only on seed, difficulty and count and
+// not on the number of threads. threads == 0 uses every core.
+const size_t batch_chunk = 4096;
+problem_set generate_problems(uint64_t seed, long difficulty, size_t count, unsigned threads = 0,
+                              bool constructive = false);
+// Like generate_problems, but skips every problem seen already holds and
+// records the ones returned. Generates in rounds until count problems are
+// found or a round adds none, so a small problem space can return fewer.
+problem_set generate_unique_problems(uint64_t seed, long difficulty, size_t count, dedupe_set &seen,
+                                     unsigned threads = 0, bool constructive = false);
+
+#include "problem_set.cpp"
@@ -3,8 +3,8 @@
 #include <iomanip>
 #include <chrono>
 #include <string>
-#include <sstream>
 #include "caculator.h"
+#include "answer_parser.h"
 #include "ui.cpp"
 
 using namespace std;
@@ -13,9 +13,8 @@ calulation c;
 string temp = "";
 string save = "";
 string pass = "";
-stringstream temps;
 int mems;
-int input = 0;
+answer_grade graded = answer_grade::invalid;
 short mode = 0;
 
 void introduction()
@@ -201,14 +200,13 @@ void game()
         end = chrono::high_resolution_clock::now();
         duration = chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
         cout << setw(consoleWidth - 1) << left << "*ʱ: " + to_string(duration) + "" << "*" << endl;
-        temps = stringstream(temp);
-        temps >> input;
+        graded = grade_answer(temp, c.get_result());
         action = 7;
     };
 
     auto action7 = [&a, &duration, &towait, &action]()
     {
-        if (input == c.get_result())
+        if (graded == answer_grade::correct)
         {
             print_line("ȷ");
             cout << "*";
@@ -395,8 +393,7 @@ void pratise()
         end = chrono::high_resolution_clock::now();
         duration = chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
         print_line("*ʱ: " + to_string(duration) + "");
-        temps = stringstream(temp);
-        temps >> input;
+        graded = grade_answer(temp, c.get_result());
         action = 11;
     };
 
@@ -407,7 +404,7 @@ void pratise()
             mode = -1;
             action = 128;
         }
-        else if (input == c.get_result())
+        else if (graded == answer_grade::correct)
         {
 
             print_line("ȷ");
@@ -488,15 +485,14 @@ void pratise()
             end = chrono::high_resolution_clock::now();
             duration = chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
             print_line("*ʱ: " + to_string(duration) + "");
-            temps = stringstream(temp);
-            temps >> input;
+            graded = grade_answer(temp, wrong[i].second);
             if (temp == "q")
             {
                 mode = -1;
                 action = 128;
                 break;
             }
-            else if (input == c.get_result())
+            else if (graded == answer_grade::correct)
             {
 
                 print_line("ȷ");
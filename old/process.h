@@ -7,15 +7,15 @@
 #include <vector>
 
 #include "caculator.h"
+#include "answer_parser.h"
 
 extern calulation c; 
 extern short mode;
 extern std::string temp;
 extern std::string save;
 extern std::string pass;
-extern std::stringstream temps;
 extern int mems;
-extern int input;
+extern answer_grade graded;
 
 // 函数声明
 